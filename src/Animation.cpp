@@ -1,63 +1,14 @@
 #include "Animation.h"
+#include "AssetPack.h"
 #include <pugixml.hpp>
 #include <cstdio>
+#include <cstring>
 
-// ---------- Animation ----------
+// ---------- AnimationLibrary ----------
 
-SDL_Rect Animation::kEmpty_{ 0,0,0,0 };
+AnimationLibrary::AnimationLibrary() {}
 
-Animation::Animation() {}
-
-void Animation::AddFrame(const SDL_Rect& r, int durationMs) {
-    frames_.push_back({ r, durationMs });
-}
-
-void Animation::SetLoop(bool v) { loop_ = v; }
-
-void Animation::Reset() {
-    currentIndex_ = 0;
-    timeInFrameMs_ = 0;
-    finishedOnce_ = false;
-}
-
-bool Animation::HasFinishedOnce() const { return finishedOnce_ && !loop_; }
-
-void Animation::Update(float dt) {
-    if (frames_.empty()) return;
-
-    timeInFrameMs_ += static_cast<int>(dt);
-
-    while (timeInFrameMs_ >= frames_[currentIndex_].durationMs) {
-        timeInFrameMs_ -= frames_[currentIndex_].durationMs;
-
-        if (currentIndex_ + 1 < static_cast<int>(frames_.size())) {
-            ++currentIndex_;
-        }
-        else {
-            if (loop_) {
-                currentIndex_ = 0;
-            }
-            else {
-                finishedOnce_ = true;
-                currentIndex_ = static_cast<int>(frames_.size()) - 1;
-                break;
-            }
-        }
-    }
-}
-
-const SDL_Rect& Animation::GetCurrentFrame() const {
-    if (frames_.empty()) return kEmpty_;
-    return frames_[currentIndex_].rect;
-}
-
-int Animation::GetFrameCount() const { return static_cast<int>(frames_.size()); }
-
-// ---------- AnimationSet ----------
-
-AnimationSet::AnimationSet() {}
-
-SDL_Rect AnimationSet::TileIdToRect(int tileid, int columns, int tileW, int tileH) {
+SDL_Rect AnimationLibrary::TileIdToRect(int tileid, int columns, int tileW, int tileH) {
     SDL_Rect r{};
     r.x = (tileid % columns) * tileW;
     r.y = (tileid / columns) * tileH;
@@ -66,11 +17,17 @@ SDL_Rect AnimationSet::TileIdToRect(int tileid, int columns, int tileW, int tile
     return r;
 }
 
-bool AnimationSet::LoadFromTSX(const char* tsxPath,
+bool AnimationLibrary::LoadFromTSX(const char* tsxPath,
     const std::unordered_map<int, std::string>& aliases)
 {
+    AssetFile file;
+    if (!file.Open(tsxPath)) {
+        std::fprintf(stderr, "TSX load failed (%s): %s\n", tsxPath, SDL_GetError());
+        return false;
+    }
+
     pugi::xml_document doc;
-    pugi::xml_parse_result ok = doc.load_file(tsxPath);
+    pugi::xml_parse_result ok = doc.load_buffer(file.GetData(), file.GetSize());
     if (!ok) {
         std::fprintf(stderr, "TSX load failed (%s): %s\n", tsxPath, ok.description());
         return false;
@@ -100,47 +57,203 @@ bool AnimationSet::LoadFromTSX(const char* tsxPath,
             name = "tile_" + std::to_string(baseId);
         }
 
-        Animation clip;
-        clip.SetLoop(true);
+        // first definition wins, names that hash alike are reported
+        ClipId id = MakeClipId(name.c_str());
+        int existing = Find(id);
+        if (existing >= 0) {
+            if (clips_[existing].name != name) {
+                std::fprintf(stderr, "TSX warning: clips %s and %s have the same id (%s)\n", clips_[existing].name.c_str(), name.c_str(), tsxPath);
+            }
+            continue;
+        }
+
+        AnimationClip clip;
+        clip.id = id;
+        clip.name = name;
+        clip.loop = true;
 
         for (pugi::xml_node f = animNode.child("frame"); f; f = f.next_sibling("frame")) {
             int frameId = f.attribute("tileid").as_int();
             int duration = f.attribute("duration").as_int(100);
+            if (duration < 1) duration = 1; // a zero length frame would never be left
             SDL_Rect r = TileIdToRect(frameId, columns_, tileW_, tileH_);
-            clip.AddFrame(r, duration);
+            clip.frames.push_back({ r, duration });
         }
+        clip.frames.shrink_to_fit();
+        for (const AnimFrame& frame : clip.frames) clip.durationMs += frame.durationMs;
 
-        clip.Reset();
-        clips_.emplace(name, std::move(clip));
+        clips_.push_back(std::move(clip));
     }
 
-    // pick first as default current
-    if (!clips_.empty()) currentName_ = clips_.begin()->first;
-
     return !clips_.empty();
 }
 
-void AnimationSet::SetCurrent(const std::string& name) {
-    if (currentName_ == name) return; // no change
-    if (!Has(name)) return;           // unknown name
-    currentName_ = name;
-    clips_[currentName_].Reset();
+// A handful of clips per library, scanning the ids beats hashing
+int AnimationLibrary::Find(ClipId id) const {
+    for (size_t i = 0; i < clips_.size(); ++i) {
+        if (clips_[i].id == id) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+size_t AnimationLibrary::GetMemoryBytes() const {
+    size_t bytes = sizeof(*this) + clips_.capacity() * sizeof(AnimationClip);
+    for (const AnimationClip& clip : clips_) {
+        bytes += clip.frames.capacity() * sizeof(AnimFrame) + clip.name.capacity();
+    }
+    return bytes;
+}
+
+// ---------- AnimationStateMachine ----------
+
+AnimationStateMachine::AnimationStateMachine() {}
+
+static bool ParseCompare(const char* text, AnimCompare& compare) {
+    static const struct { const char* name; AnimCompare compare; } compares[] = {
+        { "eq", AnimCompare::EQUAL }, { "ne", AnimCompare::NOT_EQUAL },
+        { "gt", AnimCompare::GREATER }, { "lt", AnimCompare::LESS },
+        { "ge", AnimCompare::GREATER_EQUAL }, { "le", AnimCompare::LESS_EQUAL }
+    };
+    for (const auto& entry : compares) {
+        if (std::strcmp(text, entry.name) == 0) {
+            compare = entry.compare;
+            return true;
+        }
+    }
+    return false;
 }
 
-void AnimationSet::Update(float dtSeconds) {
-    if (Has(currentName_)) clips_[currentName_].Update(dtSeconds);
+bool AnimationStateMachine::LoadFromXML(const char* path)
+{
+    AssetFile file;
+    if (!file.Open(path)) {
+        std::fprintf(stderr, "State machine load failed (%s): %s\n", path, SDL_GetError());
+        return false;
+    }
+
+    pugi::xml_document doc;
+    pugi::xml_parse_result ok = doc.load_buffer(file.GetData(), file.GetSize());
+    if (!ok) {
+        std::fprintf(stderr, "State machine load failed (%s): %s\n", path, ok.description());
+        return false;
+    }
+
+    pugi::xml_node root = doc.child("statemachine");
+    if (!root) {
+        std::fprintf(stderr, "State machine error: <statemachine> missing (%s)\n", path);
+        return false;
+    }
+
+    for (pugi::xml_node node = root.child("parameter"); node; node = node.next_sibling("parameter")) {
+        AnimParameter parameter;
+        parameter.name = node.attribute("name").as_string();
+        parameter.id = MakeParamId(parameter.name.c_str());
+        std::string type = node.attribute("type").as_string("float");
+        if (type == "bool") parameter.type = AnimParamType::BOOL;
+        else if (type == "trigger") parameter.type = AnimParamType::TRIGGER;
+        parameter.defaultValue = node.attribute("default").as_float(0.0f);
+
+        if (FindParameter(parameter.id) >= 0) {
+            std::fprintf(stderr, "State machine error: parameter %s defined twice (%s)\n", parameter.name.c_str(), path);
+            return false;
+        }
+        parameters_.push_back(parameter);
+    }
+    if (parameters_.size() > MAX_ANIM_PARAMETERS) {
+        std::fprintf(stderr, "State machine error: more than %d parameters (%s)\n", MAX_ANIM_PARAMETERS, path);
+        return false;
+    }
+
+    for (pugi::xml_node node = root.child("state"); node; node = node.next_sibling("state")) {
+        AnimState state;
+        state.name = node.attribute("name").as_string();
+        state.clip = MakeClipId(node.attribute("clip").as_string(state.name.c_str()));
+        states_.push_back(state);
+    }
+    if (states_.empty()) {
+        std::fprintf(stderr, "State machine error: no states (%s)\n", path);
+        return false;
+    }
+
+    initialState_ = FindState(root.attribute("initial").as_string(states_[0].name.c_str()));
+    if (initialState_ < 0) {
+        std::fprintf(stderr, "State machine error: unknown initial state (%s)\n", path);
+        return false;
+    }
+
+    // Read in file order, then group by source state so each state tests a contiguous range
+    std::vector<AnimTransition> transitions;
+    for (pugi::xml_node node = root.child("transition"); node; node = node.next_sibling("transition")) {
+        AnimTransition transition;
+        std::string from = node.attribute("from").as_string("any");
+        transition.from = from == "any" ? -1 : FindState(from);
+        transition.to = FindState(node.attribute("to").as_string());
+        transition.exitTime = node.attribute("exitTime").as_float(-1.0f);
+        if ((transition.from < 0 && from != "any") || transition.to < 0) {
+            std::fprintf(stderr, "State machine error: transition %s -> %s uses an unknown state (%s)\n",
+                from.c_str(), node.attribute("to").as_string(), path);
+            return false;
+        }
+
+        transition.firstCondition = static_cast<int>(conditions_.size());
+        for (pugi::xml_node conditionNode = node.child("condition"); conditionNode; conditionNode = conditionNode.next_sibling("condition")) {
+            AnimCondition condition;
+            const char* parameterName = conditionNode.attribute("parameter").as_string();
+            condition.parameter = FindParameter(MakeParamId(parameterName));
+            condition.value = conditionNode.attribute("value").as_float(1.0f);
+            if (condition.parameter < 0 || !ParseCompare(conditionNode.attribute("compare").as_string("eq"), condition.compare)) {
+                std::fprintf(stderr, "State machine error: bad condition on %s (%s)\n", parameterName, path);
+                return false;
+            }
+            conditions_.push_back(condition);
+        }
+        transition.conditionCount = static_cast<int>(conditions_.size()) - transition.firstCondition;
+        transitions.push_back(transition);
+    }
+
+    for (const AnimTransition& transition : transitions) {
+        if (transition.from < 0) transitions_.push_back(transition);
+    }
+    anyStateCount_ = static_cast<int>(transitions_.size());
+    for (int state = 0; state < static_cast<int>(states_.size()); ++state) {
+        states_[state].firstTransition = static_cast<int>(transitions_.size());
+        for (const AnimTransition& transition : transitions) {
+            if (transition.from == state) transitions_.push_back(transition);
+        }
+        states_[state].transitionCount = static_cast<int>(transitions_.size()) - states_[state].firstTransition;
+    }
+
+    return true;
+}
+
+int AnimationStateMachine::FindParameter(AnimParamId id) const {
+    for (size_t i = 0; i < parameters_.size(); ++i) {
+        if (parameters_[i].id == id) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+int AnimationStateMachine::FindState(const std::string& name) const {
+    for (size_t i = 0; i < states_.size(); ++i) {
+        if (states_[i].name == name) return static_cast<int>(i);
+    }
+    return -1;
 }
 
-const SDL_Rect& AnimationSet::GetCurrentFrame() const {
-    static SDL_Rect dummy{ 0,0,0,0 };
-    if (Has(currentName_)) return clips_.at(currentName_).GetCurrentFrame();
-    return dummy;
+size_t AnimationStateMachine::GetMemoryBytes() const {
+    size_t bytes = sizeof(*this) + parameters_.capacity() * sizeof(AnimParameter) + states_.capacity() * sizeof(AnimState)
+        + transitions_.capacity() * sizeof(AnimTransition) + conditions_.capacity() * sizeof(AnimCondition);
+    for (const AnimParameter& parameter : parameters_) bytes += parameter.name.capacity();
+    for (const AnimState& state : states_) bytes += state.name.capacity();
+    return bytes;
 }
 
-const std::string& AnimationSet::GetCurrentName() const {
-    return currentName_;
+const AnimTransition* AnimationStateMachine::GetAnyStateTransitions(int& count) const {
+    count = anyStateCount_;
+    return transitions_.data();
 }
 
-bool AnimationSet::Has(const std::string& name) const {
-    return clips_.find(name) != clips_.end();
+const AnimTransition* AnimationStateMachine::GetTransitions(int state, int& count) const {
+    count = states_[state].transitionCount;
+    return transitions_.data() + states_[state].firstTransition;
 }
@@ -2,54 +2,147 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <cstdint>
 #include <SDL3/SDL_rect.h>
 
+// Clip name hashed at compile time: constexpr ClipId kMove = MakeClipId("move")
+typedef uint32_t ClipId;
+
+constexpr ClipId MakeClipId(const char* name) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    while (*name != '\0') {
+        hash ^= static_cast<unsigned char>(*name++);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// State machine parameters are named the same way: constexpr AnimParamId kGrounded = MakeParamId("grounded")
+typedef uint32_t AnimParamId;
+
+constexpr AnimParamId MakeParamId(const char* name) {
+    return MakeClipId(name);
+}
+
+// Parameter slots of an animator, the limit of a state machine
+#define MAX_ANIM_PARAMETERS 8
+
 struct AnimFrame {
     SDL_Rect rect{};
     int durationMs = 100;
 };
 
-class Animation {
-public:
-    Animation();
-    void AddFrame(const SDL_Rect& r, int durationMs);
-    void SetLoop(bool v);
-    void Reset();
-    bool HasFinishedOnce() const;
-    void Update(float dt);
-    const SDL_Rect& GetCurrentFrame() const;
-    int GetFrameCount() const;
-
-private:
-    std::vector<AnimFrame> frames_;
-    int currentIndex_ = 0;
-    int timeInFrameMs_ = 0;
-    bool loop_ = true;
-    bool finishedOnce_ = false;
-
-    static SDL_Rect kEmpty_;
+// Frames of one animation. Immutable once loaded, shared by every entity playing it
+struct AnimationClip {
+    ClipId id = 0;
+    std::string name;  // for logs and debug display
+    std::vector<AnimFrame> frames;
+    int durationMs = 0;  // one pass over every frame
+    bool loop = true;
 };
 
-class AnimationSet {
+// Every clip of a TSX, parsed once and shared read-only (cached by the AssetManager).
+// Played by the AnimationSystem
+class AnimationLibrary {
 public:
-    AnimationSet();
+    AnimationLibrary();
 
     // load from TSX with aliases {baseTileId -> name}
     bool LoadFromTSX(const char* tsxPath,
         const std::unordered_map<int, std::string>& aliases);
 
-    // manage animations
-    void SetCurrent(const std::string& name);
-    void Update(float dtSeconds);
-    const SDL_Rect& GetCurrentFrame() const;
-    const std::string& GetCurrentName() const;
+    // Index of a clip, -1 if there is none with that id. Resolve once and keep the index
+    int Find(ClipId id) const;
+    const AnimationClip& GetClip(int index) const { return clips_[index]; }
+    int GetClipCount() const { return static_cast<int>(clips_.size()); }
 
-    bool Has(const std::string& name) const;
+    size_t GetMemoryBytes() const;
 
 private:
     int tileW_ = 0, tileH_ = 0, columns_ = 0;
-    std::unordered_map<std::string, Animation> clips_;
-    std::string currentName_;
+    std::vector<AnimationClip> clips_;  // in file order
 
     static SDL_Rect TileIdToRect(int tileid, int columns, int tileW, int tileH);
 };
+
+enum class AnimParamType {
+    FLOAT,
+    BOOL,
+    TRIGGER  // reset once a transition tests it
+};
+
+enum class AnimCompare {
+    EQUAL,
+    NOT_EQUAL,
+    GREATER,
+    LESS,
+    GREATER_EQUAL,
+    LESS_EQUAL
+};
+
+struct AnimParameter {
+    AnimParamId id = 0;
+    std::string name;
+    AnimParamType type = AnimParamType::FLOAT;
+    float defaultValue = 0.0f;
+};
+
+struct AnimCondition {
+    int parameter = 0;
+    AnimCompare compare = AnimCompare::EQUAL;
+    float value = 1.0f;
+};
+
+struct AnimTransition {
+    int from = -1;          // -1 leaves any state
+    int to = 0;
+    float exitTime = -1.0f; // fraction of the clip to play before leaving, negative for none
+    int firstCondition = 0;
+    int conditionCount = 0;
+};
+
+struct AnimState {
+    std::string name;
+    ClipId clip = 0;
+    int firstTransition = 0; // transitions of the state are contiguous
+    int transitionCount = 0;
+};
+
+// Animation states and the parameter conditions that switch between them, loaded from XML:
+// <statemachine initial="idle">
+//   <parameter name="grounded" type="bool" default="1"/>
+//   <state name="idle" clip="idle"/>
+//   <transition from="idle" to="move"><condition parameter="moving" compare="eq" value="1"/></transition>
+// </statemachine>
+// Transitions from "any" are tested first, then the current state ones, in file order.
+// Immutable once loaded and shared by every animator using it
+class AnimationStateMachine {
+public:
+    AnimationStateMachine();
+
+    bool LoadFromXML(const char* path);
+
+    // Index of a parameter, -1 if there is none with that id. Resolve once and keep the index
+    int FindParameter(AnimParamId id) const;
+    int FindState(const std::string& name) const;
+
+    int GetInitialState() const { return initialState_; }
+    const AnimState& GetState(int index) const { return states_[index]; }
+    int GetStateCount() const { return static_cast<int>(states_.size()); }
+    const std::vector<AnimParameter>& GetParameters() const { return parameters_; }
+
+    // Transitions leaving any state, then those of each state
+    const AnimTransition* GetAnyStateTransitions(int& count) const;
+    const AnimTransition* GetTransitions(int state, int& count) const;
+    const AnimCondition& GetCondition(int index) const { return conditions_[index]; }
+
+    size_t GetMemoryBytes() const;
+
+private:
+    int initialState_ = 0;
+    std::vector<AnimParameter> parameters_;
+    std::vector<AnimState> states_;
+    std::vector<AnimTransition> transitions_;  // any-state ones first, then grouped by state
+    int anyStateCount_ = 0;
+    std::vector<AnimCondition> conditions_;
+};
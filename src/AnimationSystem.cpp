@@ -0,0 +1,317 @@
+#include "AnimationSystem.h"
+#include "Log.h"
+
+static const SDL_Rect emptyRect = { 0, 0, 0, 0 };
+
+AnimationSystem::AnimationSystem() : Module()
+{
+	name = "animations";
+}
+
+// Destructor
+AnimationSystem::~AnimationSystem()
+{}
+
+// Called each loop iteration
+bool AnimationSystem::Update(float dt)
+{
+	const int count = (int)libraries.size();
+	float* stateTime = stateTimes.data();
+	for (int i = 0; i < count; ++i) stateTime[i] += dt;
+
+	const AnimFrame* const* clipFrame = clipFrames.data();
+	const int* frameCount = frameCounts.data();
+	const uint8_t* loop = loops.data();
+	int* frame = frames.data();
+	float* frameTime = frameTimes.data();
+	uint8_t* done = finished.data();
+	SDL_Rect* rect = rects.data();
+
+	for (int i = 0; i < count; ++i) {
+		if (frameCount[i] == 0 || done[i]) continue;
+
+		const AnimFrame* clip = clipFrame[i];
+		float time = frameTime[i] + dt;
+		int current = frame[i];
+
+		// Usually no frame change; a long frame time may skip several frames
+		while (time >= (float)clip[current].durationMs) {
+			time -= (float)clip[current].durationMs;
+			if (current + 1 < frameCount[i]) {
+				current++;
+			}
+			else if (loop[i]) {
+				current = 0;
+			}
+			else {
+				done[i] = 1;
+				time = 0.0f;
+				break;
+			}
+		}
+
+		frameTime[i] = time;
+		frame[i] = current;
+		rect[i] = clip[current].rect;
+	}
+
+	UpdateStateMachines();
+
+	return true;
+}
+
+// Called before quitting
+bool AnimationSystem::CleanUp()
+{
+	LOG("Freeing animation system");
+
+	libraries.clear();
+	clips.clear();
+	clipFrames.clear();
+	frameCounts.clear();
+	frames.clear();
+	frameTimes.clear();
+	loops.clear();
+	finished.clear();
+	rects.clear();
+	stateMachines.clear();
+	states.clear();
+	stateTimes.clear();
+	parameterValues.clear();
+	denseToSlot.clear();
+
+	// Later Destroy calls find stale handles
+	for (size_t slot = 0; slot < slotToDense.size(); ++slot) {
+		if (slotToDense[slot] < 0) continue;
+		slotToDense[slot] = -1;
+		if (++slotGenerations[slot] == 0) slotGenerations[slot] = 1;
+		freeSlots.push_back((uint32_t)slot);
+	}
+
+	return true;
+}
+
+AnimatorHandle AnimationSystem::Create(const AnimationLibrary* library, const AnimationStateMachine* stateMachine)
+{
+	uint32_t slot;
+	if (!freeSlots.empty()) {
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else {
+		slot = (uint32_t)slotToDense.size();
+		slotToDense.push_back(-1);
+		slotGenerations.push_back(1);
+	}
+
+	slotToDense[slot] = (int)libraries.size();
+	libraries.push_back(library);
+	clips.push_back(-1);
+	clipFrames.push_back(nullptr);
+	frameCounts.push_back(0);
+	frames.push_back(0);
+	frameTimes.push_back(0.0f);
+	loops.push_back(1);
+	finished.push_back(0);
+	rects.push_back(emptyRect);
+	stateMachines.push_back(stateMachine);
+	states.push_back(-1);
+	stateTimes.push_back(0.0f);
+	parameterValues.resize(parameterValues.size() + MAX_ANIM_PARAMETERS, 0.0f);
+	denseToSlot.push_back(slot);
+
+	int dense = slotToDense[slot];
+	if (stateMachine != nullptr) {
+		const std::vector<AnimParameter>& parameters = stateMachine->GetParameters();
+		for (size_t i = 0; i < parameters.size(); ++i) {
+			parameterValues[(size_t)dense * MAX_ANIM_PARAMETERS + i] = parameters[i].defaultValue;
+		}
+		EnterState(dense, stateMachine->GetInitialState());
+	}
+	else if (library != nullptr && library->GetClipCount() > 0) {
+		PlayClip(dense, 0);
+	}
+
+	return AnimatorHandle{ slot, slotGenerations[slot] };
+}
+
+void AnimationSystem::Destroy(AnimatorHandle animator)
+{
+	int dense = Resolve(animator);
+	if (dense < 0) return;
+
+	// Move the last animator into the hole to keep the arrays packed
+	int last = (int)libraries.size() - 1;
+	if (dense != last) {
+		libraries[dense] = libraries[last];
+		clips[dense] = clips[last];
+		clipFrames[dense] = clipFrames[last];
+		frameCounts[dense] = frameCounts[last];
+		frames[dense] = frames[last];
+		frameTimes[dense] = frameTimes[last];
+		loops[dense] = loops[last];
+		finished[dense] = finished[last];
+		rects[dense] = rects[last];
+		stateMachines[dense] = stateMachines[last];
+		states[dense] = states[last];
+		stateTimes[dense] = stateTimes[last];
+		for (int p = 0; p < MAX_ANIM_PARAMETERS; ++p) {
+			parameterValues[(size_t)dense * MAX_ANIM_PARAMETERS + p] = parameterValues[(size_t)last * MAX_ANIM_PARAMETERS + p];
+		}
+		denseToSlot[dense] = denseToSlot[last];
+		slotToDense[denseToSlot[dense]] = dense;
+	}
+
+	libraries.pop_back();
+	clips.pop_back();
+	clipFrames.pop_back();
+	frameCounts.pop_back();
+	frames.pop_back();
+	frameTimes.pop_back();
+	loops.pop_back();
+	finished.pop_back();
+	rects.pop_back();
+	stateMachines.pop_back();
+	states.pop_back();
+	stateTimes.pop_back();
+	parameterValues.resize(parameterValues.size() - MAX_ANIM_PARAMETERS);
+	denseToSlot.pop_back();
+
+	slotToDense[animator.index] = -1;
+	if (++slotGenerations[animator.index] == 0) slotGenerations[animator.index] = 1;
+	freeSlots.push_back(animator.index);
+}
+
+int AnimationSystem::FindClip(AnimatorHandle animator, ClipId id) const
+{
+	int dense = Resolve(animator);
+	if (dense < 0 || libraries[dense] == nullptr) return -1;
+	return libraries[dense]->Find(id);
+}
+
+void AnimationSystem::Play(AnimatorHandle animator, int clip)
+{
+	int dense = Resolve(animator);
+	if (dense >= 0) PlayClip(dense, clip);
+}
+
+void AnimationSystem::PlayClip(int dense, int clip)
+{
+	if (libraries[dense] == nullptr) return;
+	if (clip < 0 || clip >= libraries[dense]->GetClipCount()) return; // unknown clip
+	if (clip == clips[dense]) return;                                 // no change
+
+	const AnimationClip& data = libraries[dense]->GetClip(clip);
+	clips[dense] = clip;
+	clipFrames[dense] = data.frames.data();
+	frameCounts[dense] = (int)data.frames.size();
+	frames[dense] = 0;
+	frameTimes[dense] = 0.0f;
+	loops[dense] = data.loop ? 1 : 0;
+	finished[dense] = 0;
+	rects[dense] = data.frames.empty() ? emptyRect : data.frames[0].rect;
+}
+
+void AnimationSystem::EnterState(int dense, int state)
+{
+	const AnimationStateMachine* machine = stateMachines[dense];
+	states[dense] = state;
+	stateTimes[dense] = 0.0f;
+	if (libraries[dense] != nullptr) PlayClip(dense, libraries[dense]->Find(machine->GetState(state).clip));
+}
+
+// Take the first transition whose conditions hold, any-state ones first
+void AnimationSystem::UpdateStateMachines()
+{
+	const int count = (int)libraries.size();
+	for (int i = 0; i < count; ++i) {
+		const AnimationStateMachine* machine = stateMachines[i];
+		if (machine == nullptr) continue;
+
+		float* values = &parameterValues[(size_t)i * MAX_ANIM_PARAMETERS];
+		int clipLength = clips[i] >= 0 ? libraries[i]->GetClip(clips[i]).durationMs : 0;
+
+		int anyCount, stateCount;
+		const AnimTransition* anyTransitions = machine->GetAnyStateTransitions(anyCount);
+		const AnimTransition* stateTransitions = machine->GetTransitions(states[i], stateCount);
+
+		const AnimTransition* taken = nullptr;
+		for (int t = 0; t < anyCount + stateCount && taken == nullptr; ++t) {
+			const AnimTransition& transition = t < anyCount ? anyTransitions[t] : stateTransitions[t - anyCount];
+			if (transition.from < 0 && transition.to == states[i]) continue; // already there
+			if (transition.exitTime >= 0.0f && stateTimes[i] < transition.exitTime * clipLength) continue;
+			if (CheckConditions(*machine, transition, values)) taken = &transition;
+		}
+		if (taken == nullptr) continue;
+
+		// Triggers fire one transition
+		for (int c = 0; c < taken->conditionCount; ++c) {
+			int parameter = machine->GetCondition(taken->firstCondition + c).parameter;
+			if (machine->GetParameters()[parameter].type == AnimParamType::TRIGGER) values[parameter] = 0.0f;
+		}
+		EnterState(i, taken->to);
+	}
+}
+
+bool AnimationSystem::CheckConditions(const AnimationStateMachine& machine, const AnimTransition& transition, const float* values) const
+{
+	for (int c = 0; c < transition.conditionCount; ++c) {
+		const AnimCondition& condition = machine.GetCondition(transition.firstCondition + c);
+		float value = values[condition.parameter];
+		bool holds = false;
+		switch (condition.compare) {
+		case AnimCompare::EQUAL: holds = value == condition.value; break;
+		case AnimCompare::NOT_EQUAL: holds = value != condition.value; break;
+		case AnimCompare::GREATER: holds = value > condition.value; break;
+		case AnimCompare::LESS: holds = value < condition.value; break;
+		case AnimCompare::GREATER_EQUAL: holds = value >= condition.value; break;
+		case AnimCompare::LESS_EQUAL: holds = value <= condition.value; break;
+		}
+		if (!holds) return false;
+	}
+	return true;
+}
+
+int AnimationSystem::FindParameter(AnimatorHandle animator, AnimParamId id) const
+{
+	int dense = Resolve(animator);
+	if (dense < 0 || stateMachines[dense] == nullptr) return -1;
+	return stateMachines[dense]->FindParameter(id);
+}
+
+void AnimationSystem::SetParameter(AnimatorHandle animator, int parameter, float value)
+{
+	int dense = Resolve(animator);
+	if (dense < 0 || parameter < 0 || parameter >= MAX_ANIM_PARAMETERS) return;
+	parameterValues[(size_t)dense * MAX_ANIM_PARAMETERS + parameter] = value;
+}
+
+int AnimationSystem::GetState(AnimatorHandle animator) const
+{
+	int dense = Resolve(animator);
+	return dense >= 0 ? states[dense] : -1;
+}
+
+int AnimationSystem::GetClip(AnimatorHandle animator) const
+{
+	int dense = Resolve(animator);
+	return dense >= 0 ? clips[dense] : -1;
+}
+
+bool AnimationSystem::HasFinished(AnimatorHandle animator) const
+{
+	int dense = Resolve(animator);
+	return dense >= 0 && finished[dense] != 0;
+}
+
+const SDL_Rect& AnimationSystem::GetFrame(AnimatorHandle animator) const
+{
+	int dense = Resolve(animator);
+	return dense >= 0 ? rects[dense] : emptyRect;
+}
+
+int AnimationSystem::Resolve(AnimatorHandle animator) const
+{
+	if (animator.index >= slotToDense.size() || slotGenerations[animator.index] != animator.generation) return -1;
+	return slotToDense[animator.index];
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Module.h"
+#include "Animation.h"
+#include <SDL3/SDL_rect.h>
+#include <vector>
+#include <cstdint>
+
+// Reference to an animator, stale once it is destroyed
+struct AnimatorHandle
+{
+	uint32_t index = 0;
+	uint32_t generation = 0; // never a live generation
+
+	bool IsValid() const { return generation != 0; }
+	bool operator==(const AnimatorHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const AnimatorHandle& other) const { return !(*this == other); }
+};
+
+// Playback of every animated sprite.
+// The state of all animators is kept in parallel arrays and advanced in one loop before the
+// entities update, so each entity only reads its resolved source rect when drawing.
+// Animators driven by a state machine only get parameters from gameplay code; the transitions
+// of all of them are evaluated in a second batched pass.
+class AnimationSystem : public Module
+{
+public:
+
+	AnimationSystem();
+
+	// Destructor
+	virtual ~AnimationSystem();
+
+	// Called each loop iteration
+	bool Update(float dt);
+
+	// Called before quitting
+	bool CleanUp();
+
+	// Animator over a shared library, which must outlive it like the state machine.
+	// Starts on the initial state of the machine, or on the first clip without one
+	AnimatorHandle Create(const AnimationLibrary* library, const AnimationStateMachine* stateMachine = nullptr);
+	void Destroy(AnimatorHandle animator);
+
+	// Clip index to pass to Play, -1 if the library has no such clip
+	int FindClip(AnimatorHandle animator, ClipId id) const;
+
+	// Switch clip and restart it, playing the current clip again does nothing.
+	// For animators without a state machine
+	void Play(AnimatorHandle animator, int clip);
+	int GetClip(AnimatorHandle animator) const;
+	bool HasFinished(AnimatorHandle animator) const;
+
+	// State machine parameters: index to pass to the setters, -1 if the machine has no such parameter
+	int FindParameter(AnimatorHandle animator, AnimParamId id) const;
+	void SetParameter(AnimatorHandle animator, int parameter, float value);
+	void SetBool(AnimatorHandle animator, int parameter, bool value) { SetParameter(animator, parameter, value ? 1.0f : 0.0f); }
+	void SetTrigger(AnimatorHandle animator, int parameter) { SetParameter(animator, parameter, 1.0f); }
+	int GetState(AnimatorHandle animator) const;
+
+	// Source rect of the current frame, as of the last Update
+	const SDL_Rect& GetFrame(AnimatorHandle animator) const;
+
+	int GetAnimatorCount() const { return (int)libraries.size(); }
+
+private:
+
+	// Dense position of a live animator, -1 for stale handles
+	int Resolve(AnimatorHandle animator) const;
+
+	void PlayClip(int dense, int clip);
+	void EnterState(int dense, int state);
+	void UpdateStateMachines();
+	bool CheckConditions(const AnimationStateMachine& machine, const AnimTransition& transition, const float* values) const;
+
+private:
+
+	// Dense arrays, one element per live animator
+	std::vector<const AnimationLibrary*> libraries;
+	std::vector<int> clips;
+	std::vector<const AnimFrame*> clipFrames;
+	std::vector<int> frameCounts;
+	std::vector<int> frames;
+	std::vector<float> frameTimes;  // ms into the current frame, fractions kept
+	std::vector<uint8_t> loops;
+	std::vector<uint8_t> finished;
+	std::vector<SDL_Rect> rects;
+	std::vector<const AnimationStateMachine*> stateMachines;
+	std::vector<int> states;
+	std::vector<float> stateTimes;       // ms in the current state
+	std::vector<float> parameterValues;  // MAX_ANIM_PARAMETERS per animator
+	std::vector<uint32_t> denseToSlot;
+
+	// Handle slots, moved along when the dense arrays are compacted
+	std::vector<int> slotToDense;
+	std::vector<uint32_t> slotGenerations;
+	std::vector<uint32_t> freeSlots;
+};
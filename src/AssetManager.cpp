@@ -0,0 +1,535 @@
+#include "AssetManager.h"
+#include "Engine.h"
+#include "PerfTimer.h"
+#include "Log.h"
+
+#include <map>
+
+AssetManager::AssetManager() : Module()
+{
+	name = "assets";
+}
+
+// Destructor
+AssetManager::~AssetManager()
+{
+	StopWorkers();
+}
+
+// Called before render is available
+bool AssetManager::Awake()
+{
+	LOG("Loading Asset Manager");
+
+	workerCount = configParameters.child("workers").attribute("value").as_int(workerCount);
+	StartWorkers();
+
+	return true;
+}
+
+// Called each loop iteration
+bool AssetManager::PreUpdate()
+{
+	FinishLoads();
+	return true;
+}
+
+// Called before quitting
+bool AssetManager::CleanUp()
+{
+	LOG("Freeing Asset Manager");
+
+	StopWorkers();
+
+	double loadMs = 0.0;
+	int loaded = 0;
+	for (const AssetRecord& record : records) {
+		if (record.state == AssetState::INVALID) continue;
+		loadMs += record.loadMs;
+		loaded++;
+	}
+	LOG("Assets: %d loaded in %.2f ms, %.1f KB", loaded, loadMs, GetTotalBytes() / 1024.0);
+
+	for (AssetRecord& record : records) {
+		if (record.state != AssetState::INVALID) FreeRecord(record);
+	}
+	records.clear();
+	freeRecords.clear();
+	keyIndex.clear();
+	pendingCallbacks.clear();
+
+	return true;
+}
+
+// ---------- Loading ----------
+
+TextureAsset AssetManager::LoadTexture(const char* path)
+{
+	std::string key = Textures::NormalizePath(path);
+	uint32_t index = Request(AssetType::TEXTURE, key, key.c_str(), nullptr, false);
+	TextureAsset handle{ index, records[index].generation };
+	WaitFor(index, handle.generation);
+	return handle;
+}
+
+SoundAsset AssetManager::LoadSound(const char* path)
+{
+	std::string key = Textures::NormalizePath(path);
+	uint32_t index = Request(AssetType::SOUND, key, key.c_str(), nullptr, false);
+	SoundAsset handle{ index, records[index].generation };
+	WaitFor(index, handle.generation);
+	return handle;
+}
+
+AnimationAsset AssetManager::LoadAnimations(const char* tsxPath, const std::unordered_map<int, std::string>& aliases)
+{
+	std::string path = Textures::NormalizePath(tsxPath);
+	uint32_t index = Request(AssetType::ANIMATION, AnimationKey(path.c_str(), aliases), path.c_str(), &aliases, false);
+	AnimationAsset handle{ index, records[index].generation };
+	WaitFor(index, handle.generation);
+	return handle;
+}
+
+StateMachineAsset AssetManager::LoadStateMachine(const char* path)
+{
+	std::string key = Textures::NormalizePath(path);
+	uint32_t index = Request(AssetType::STATE_MACHINE, key, key.c_str(), nullptr, false);
+	StateMachineAsset handle{ index, records[index].generation };
+	WaitFor(index, handle.generation);
+	return handle;
+}
+
+TextureAsset AssetManager::LoadTextureAsync(const char* path, std::function<void(TextureAsset)> onLoaded)
+{
+	std::string key = Textures::NormalizePath(path);
+	uint32_t index = Request(AssetType::TEXTURE, key, key.c_str(), nullptr, true);
+	TextureAsset handle{ index, records[index].generation };
+	if (onLoaded) AddCallback(index, [onLoaded, handle]() { onLoaded(handle); });
+	return handle;
+}
+
+SoundAsset AssetManager::LoadSoundAsync(const char* path, std::function<void(SoundAsset)> onLoaded)
+{
+	std::string key = Textures::NormalizePath(path);
+	uint32_t index = Request(AssetType::SOUND, key, key.c_str(), nullptr, true);
+	SoundAsset handle{ index, records[index].generation };
+	if (onLoaded) AddCallback(index, [onLoaded, handle]() { onLoaded(handle); });
+	return handle;
+}
+
+AnimationAsset AssetManager::LoadAnimationsAsync(const char* tsxPath, const std::unordered_map<int, std::string>& aliases,
+	std::function<void(AnimationAsset)> onLoaded)
+{
+	std::string path = Textures::NormalizePath(tsxPath);
+	uint32_t index = Request(AssetType::ANIMATION, AnimationKey(path.c_str(), aliases), path.c_str(), &aliases, true);
+	AnimationAsset handle{ index, records[index].generation };
+	if (onLoaded) AddCallback(index, [onLoaded, handle]() { onLoaded(handle); });
+	return handle;
+}
+
+StateMachineAsset AssetManager::LoadStateMachineAsync(const char* path, std::function<void(StateMachineAsset)> onLoaded)
+{
+	std::string key = Textures::NormalizePath(path);
+	uint32_t index = Request(AssetType::STATE_MACHINE, key, key.c_str(), nullptr, true);
+	StateMachineAsset handle{ index, records[index].generation };
+	if (onLoaded) AddCallback(index, [onLoaded, handle]() { onLoaded(handle); });
+	return handle;
+}
+
+uint32_t AssetManager::Request(AssetType type, const std::string& key, const char* path,
+	const std::unordered_map<int, std::string>* aliases, bool async)
+{
+	auto it = keyIndex.find(key);
+	if (it != keyIndex.end()) {
+		records[it->second].refCount++;
+		return it->second;
+	}
+
+	uint32_t index;
+	if (!freeRecords.empty()) {
+		index = freeRecords.back();
+		freeRecords.pop_back();
+	}
+	else {
+		index = (uint32_t)records.size();
+		records.emplace_back();
+	}
+
+	AssetRecord& record = records[index];
+	record.type = type;
+	record.key = key;
+	record.state = AssetState::LOADING;
+	record.refCount = 1;
+	record.loadMs = 0.0;
+	record.bytes = 0;
+	keyIndex[key] = index;
+
+	std::unique_ptr<LoadJob> job(new LoadJob());
+	job->type = type;
+	job->index = index;
+	job->generation = record.generation;
+	job->path = path;
+	if (aliases != nullptr) job->aliases = *aliases;
+
+	if (async && !workers.empty()) {
+		jobsInFlight++;
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			pendingJobs.push_back(std::move(job));
+		}
+		jobCondition.notify_one();
+	}
+	else {
+		RunJob(*job);
+		FinishJob(*job);
+	}
+
+	return index;
+}
+
+void AssetManager::AddCallback(uint32_t index, std::function<void()> callback)
+{
+	// Finished assets still report from PreUpdate, never from inside the load call
+	if (records[index].state == AssetState::LOADING) records[index].callbacks.push_back(std::move(callback));
+	else pendingCallbacks.push_back(std::move(callback));
+}
+
+// Block until an asset requested in the background is finished
+void AssetManager::WaitFor(uint32_t index, uint32_t generation)
+{
+	auto isLoading = [this, index, generation]() {
+		return index < records.size() && records[index].generation == generation && records[index].state == AssetState::LOADING;
+	};
+
+	// Only the awaited job is finished here, other loads and every callback wait for PreUpdate
+	if (!isLoading()) return;
+
+	// Not picked by a worker yet: decode it here instead of waiting behind the queue
+	std::unique_ptr<LoadJob> job;
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		for (auto it = pendingJobs.begin(); it != pendingJobs.end(); ++it) {
+			if ((*it)->index == index && (*it)->generation == generation) {
+				job = std::move(*it);
+				pendingJobs.erase(it);
+				break;
+			}
+		}
+	}
+
+	if (job) {
+		RunJob(*job);
+	}
+	else {
+		// Running on a worker: wait for it to show up in the done list
+		std::unique_lock<std::mutex> lock(doneMutex);
+		auto findDone = [this, index, generation]() {
+			for (auto it = doneJobs.begin(); it != doneJobs.end(); ++it) {
+				if ((*it)->index == index && (*it)->generation == generation) return it;
+			}
+			return doneJobs.end();
+		};
+		doneCondition.wait(lock, [&]() { return findDone() != doneJobs.end(); });
+
+		auto it = findDone();
+		job = std::move(*it);
+		doneJobs.erase(it);
+	}
+
+	jobsInFlight--;
+	FinishJob(*job);
+}
+
+// Decode step, runs on a worker: no renderer, device nor record access
+void AssetManager::RunJob(LoadJob& job) const
+{
+	PerfTimer timer;
+
+	switch (job.type) {
+	case AssetType::TEXTURE:
+		job.ok = Engine::GetInstance().textures->DecodeImage(job.path, job.image);
+		break;
+	case AssetType::SOUND:
+		job.ok = Audio::LoadWavFile(job.path.c_str(), job.sound);
+		break;
+	case AssetType::ANIMATION:
+		job.ok = job.animations.LoadFromTSX(job.path.c_str(), job.aliases);
+		break;
+	case AssetType::STATE_MACHINE:
+		job.ok = job.stateMachine.LoadFromXML(job.path.c_str());
+		break;
+	}
+
+	job.decodeMs = timer.ReadMs();
+}
+
+// Main thread step: hand the decoded data to its module and notify the listeners
+void AssetManager::FinishJob(LoadJob& job)
+{
+	AssetRecord* record = Resolve(job.index, job.generation, job.type);
+	if (record == nullptr) {
+		// Released while it was loading
+		DiscardJob(job);
+		return;
+	}
+
+	PerfTimer timer;
+	bool ok = job.ok;
+
+	switch (job.type) {
+	case AssetType::TEXTURE:
+		if (ok) {
+			record->texture = Engine::GetInstance().textures->AcquireDecoded(job.path.c_str(), job.image);
+			ok = record->texture.IsValid();
+		}
+		if (ok) {
+			int width, height;
+			Engine::GetInstance().textures->GetSize(record->texture, width, height);
+			record->bytes = (size_t)width * height * 4;
+		}
+		else {
+			LOG("Could not load texture asset %s. %s", job.path.c_str(), job.image.error.c_str());
+		}
+		break;
+	case AssetType::SOUND:
+		if (ok) {
+			record->bytes = job.sound.len;
+			record->sound = Engine::GetInstance().audio->AddFx(job.sound);
+			ok = record->sound != 0;
+		}
+		if (!ok) LOG("Could not load sound asset %s", job.path.c_str());
+		break;
+	case AssetType::ANIMATION:
+		if (ok) {
+			record->animations.reset(new AnimationLibrary(std::move(job.animations)));
+			record->bytes = record->animations->GetMemoryBytes();
+		}
+		else {
+			LOG("Could not load animation asset %s", job.path.c_str());
+		}
+		break;
+	case AssetType::STATE_MACHINE:
+		if (ok) {
+			record->stateMachine.reset(new AnimationStateMachine(std::move(job.stateMachine)));
+			record->bytes = record->stateMachine->GetMemoryBytes();
+		}
+		else {
+			LOG("Could not load state machine asset %s", job.path.c_str());
+		}
+		break;
+	}
+
+	record->state = ok ? AssetState::READY : AssetState::FAILED;
+	record->loadMs = job.decodeMs + timer.ReadMs();
+
+	// Callbacks always run from FinishLoads, never inside a load call.
+	// They may load more assets and move the records
+	for (std::function<void()>& callback : record->callbacks) pendingCallbacks.push_back(std::move(callback));
+	record->callbacks.clear();
+}
+
+void AssetManager::DiscardJob(LoadJob& job) const
+{
+	Audio::FreeSound(job.sound);
+}
+
+void AssetManager::FinishLoads()
+{
+	if (jobsInFlight > 0) {
+		std::vector<std::unique_ptr<LoadJob>> finished;
+		{
+			std::lock_guard<std::mutex> lock(doneMutex);
+			finished.swap(doneJobs);
+		}
+
+		for (std::unique_ptr<LoadJob>& job : finished) {
+			jobsInFlight--;
+			FinishJob(*job);
+		}
+	}
+
+	if (!pendingCallbacks.empty()) {
+		std::vector<std::function<void()>> callbacks;
+		callbacks.swap(pendingCallbacks);
+		for (std::function<void()>& callback : callbacks) callback();
+	}
+}
+
+// ---------- Records ----------
+
+void AssetManager::ReleaseRecord(uint32_t index, uint32_t generation, AssetType type)
+{
+	AssetRecord* record = Resolve(index, generation, type);
+	if (record == nullptr || --record->refCount > 0) return;
+
+	FreeRecord(*record);
+	freeRecords.push_back(index);
+}
+
+void AssetManager::FreeRecord(AssetRecord& record)
+{
+	switch (record.type) {
+	case AssetType::TEXTURE:
+		if (record.texture.IsValid()) Engine::GetInstance().textures->Release(record.texture);
+		break;
+	case AssetType::SOUND:
+		if (record.sound != 0) Engine::GetInstance().audio->UnLoadFx(record.sound);
+		break;
+	case AssetType::ANIMATION:
+	case AssetType::STATE_MACHINE:
+		break;
+	}
+
+	keyIndex.erase(record.key);
+	record.key.clear();
+	record.texture = TextureHandle();
+	record.sound = 0;
+	record.animations.reset();
+	record.stateMachine.reset();
+	record.callbacks.clear();
+	record.state = AssetState::INVALID;
+	record.refCount = 0;
+
+	// Stale handles and in-flight jobs of the old asset stop resolving
+	if (++record.generation == 0) record.generation = 1;
+}
+
+AssetManager::AssetRecord* AssetManager::Resolve(uint32_t index, uint32_t generation, AssetType type)
+{
+	if (index >= records.size()) return nullptr;
+	AssetRecord& record = records[index];
+	if (record.generation != generation || record.type != type || record.state == AssetState::INVALID) return nullptr;
+	return &record;
+}
+
+const AssetManager::AssetRecord* AssetManager::Resolve(uint32_t index, uint32_t generation, AssetType type) const
+{
+	if (index >= records.size()) return nullptr;
+	const AssetRecord& record = records[index];
+	if (record.generation != generation || record.type != type || record.state == AssetState::INVALID) return nullptr;
+	return &record;
+}
+
+// Animation sets differ by their aliases too, sorted so the key does not depend on the map order
+std::string AssetManager::AnimationKey(const char* tsxPath, const std::unordered_map<int, std::string>& aliases)
+{
+	std::map<int, std::string> sorted(aliases.begin(), aliases.end());
+	std::string key = tsxPath;
+	for (const auto& alias : sorted) {
+		key += '|';
+		key += std::to_string(alias.first);
+		key += '=';
+		key += alias.second;
+	}
+	return key;
+}
+
+// ---------- Queries ----------
+
+TextureHandle AssetManager::GetTexture(TextureAsset asset) const
+{
+	const AssetRecord* record = Resolve(asset.index, asset.generation, AssetType::TEXTURE);
+	return record != nullptr ? record->texture : TextureHandle();
+}
+
+int AssetManager::GetSound(SoundAsset asset) const
+{
+	const AssetRecord* record = Resolve(asset.index, asset.generation, AssetType::SOUND);
+	return record != nullptr ? record->sound : 0;
+}
+
+const AnimationLibrary* AssetManager::GetAnimations(AnimationAsset asset) const
+{
+	const AssetRecord* record = Resolve(asset.index, asset.generation, AssetType::ANIMATION);
+	return record != nullptr ? record->animations.get() : nullptr;
+}
+
+const AnimationStateMachine* AssetManager::GetStateMachine(StateMachineAsset asset) const
+{
+	const AssetRecord* record = Resolve(asset.index, asset.generation, AssetType::STATE_MACHINE);
+	return record != nullptr ? record->stateMachine.get() : nullptr;
+}
+
+void AssetManager::GetStats(std::vector<AssetStats>& stats) const
+{
+	stats.clear();
+	for (const AssetRecord& record : records) {
+		if (record.state == AssetState::INVALID) continue;
+		stats.push_back(AssetStats{ record.key, record.type, record.state, record.refCount, record.loadMs, record.bytes });
+	}
+}
+
+size_t AssetManager::GetTotalBytes() const
+{
+	size_t total = 0;
+	for (const AssetRecord& record : records) {
+		if (record.state == AssetState::READY) total += record.bytes;
+	}
+	return total;
+}
+
+void AssetManager::LogStats() const
+{
+	static const char* typeNames[] = { "texture", "sound", "animation", "state machine" };
+	static const char* stateNames[] = { "invalid", "loading", "ready", "failed" };
+
+	std::vector<AssetStats> stats;
+	GetStats(stats);
+	for (const AssetStats& asset : stats) {
+		LOG("Asset %s [%s, %s] refs: %d, load: %.2f ms, %.1f KB", asset.key.c_str(), typeNames[(int)asset.type],
+			stateNames[(int)asset.state], asset.refCount, asset.loadMs, asset.bytes / 1024.0);
+	}
+	LOG("Assets: %d, %.1f KB", (int)stats.size(), GetTotalBytes() / 1024.0);
+}
+
+// ---------- Workers ----------
+
+void AssetManager::StartWorkers()
+{
+	stopping = false;
+	for (int i = 0; i < workerCount; ++i) {
+		workers.emplace_back(&AssetManager::WorkerLoop, this);
+	}
+}
+
+void AssetManager::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stopping = true;
+	}
+	jobCondition.notify_all();
+
+	for (std::thread& worker : workers) worker.join();
+	workers.clear();
+
+	// Loads nobody will finish
+	for (std::unique_ptr<LoadJob>& job : pendingJobs) DiscardJob(*job);
+	pendingJobs.clear();
+	for (std::unique_ptr<LoadJob>& job : doneJobs) DiscardJob(*job);
+	doneJobs.clear();
+	jobsInFlight = 0;
+}
+
+void AssetManager::WorkerLoop()
+{
+	for (;;) {
+		std::unique_ptr<LoadJob> job;
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobCondition.wait(lock, [this]() { return stopping || !pendingJobs.empty(); });
+			if (stopping) return;
+
+			job = std::move(pendingJobs.front());
+			pendingJobs.pop_front();
+		}
+
+		RunJob(*job);
+
+		{
+			std::lock_guard<std::mutex> lock(doneMutex);
+			doneJobs.push_back(std::move(job));
+		}
+		doneCondition.notify_all();
+	}
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include "Module.h"
+#include "Textures.h"
+#include "Audio.h"
+#include "Animation.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+enum class AssetType
+{
+	TEXTURE,
+	SOUND,
+	ANIMATION,
+	STATE_MACHINE
+};
+
+enum class AssetState
+{
+	INVALID,
+	LOADING,
+	READY,
+	FAILED
+};
+
+struct TextureAssetTag { static const AssetType type = AssetType::TEXTURE; };
+struct SoundAssetTag { static const AssetType type = AssetType::SOUND; };
+struct AnimationAssetTag { static const AssetType type = AssetType::ANIMATION; };
+struct StateMachineAssetTag { static const AssetType type = AssetType::STATE_MACHINE; };
+
+// Typed reference to an asset, stale once its last reference is released.
+// The tag keeps a sound handle from being used where a texture is expected
+template <typename Tag>
+struct AssetHandle
+{
+	uint32_t index = 0;
+	uint32_t generation = 0; // never a live generation
+
+	bool IsValid() const { return generation != 0; }
+	bool operator==(const AssetHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const AssetHandle& other) const { return !(*this == other); }
+};
+
+typedef AssetHandle<TextureAssetTag> TextureAsset;
+typedef AssetHandle<SoundAssetTag> SoundAsset;
+typedef AssetHandle<AnimationAssetTag> AnimationAsset;
+typedef AssetHandle<StateMachineAssetTag> StateMachineAsset;
+
+struct AssetStats
+{
+	std::string key;
+	AssetType type;
+	AssetState state;
+	int refCount;
+	double loadMs;  // decoding plus the main thread upload
+	size_t bytes;   // estimated memory of the loaded data
+};
+
+// Single entry point for the game assets.
+// Requests for the same file share one load; decoding runs on worker threads and the result is
+// handed to Textures / Audio on the main thread in PreUpdate, where the load callbacks are called.
+class AssetManager : public Module
+{
+public:
+
+	AssetManager();
+
+	// Destructor
+	virtual ~AssetManager();
+
+	// Called before render is available
+	bool Awake();
+
+	// Called each loop iteration
+	bool PreUpdate();
+
+	// Called before quitting
+	bool CleanUp();
+
+	// Blocking loads, the asset is ready on return unless it failed.
+	// Every load must be paired with a Release
+	TextureAsset LoadTexture(const char* path);
+	SoundAsset LoadSound(const char* path);
+	AnimationAsset LoadAnimations(const char* tsxPath, const std::unordered_map<int, std::string>& aliases);
+	StateMachineAsset LoadStateMachine(const char* path);
+
+	// Background loads. onLoaded is called from PreUpdate once the asset is ready or failed,
+	// also when it was already loaded
+	TextureAsset LoadTextureAsync(const char* path, std::function<void(TextureAsset)> onLoaded = nullptr);
+	SoundAsset LoadSoundAsync(const char* path, std::function<void(SoundAsset)> onLoaded = nullptr);
+	AnimationAsset LoadAnimationsAsync(const char* tsxPath, const std::unordered_map<int, std::string>& aliases,
+		std::function<void(AnimationAsset)> onLoaded = nullptr);
+	StateMachineAsset LoadStateMachineAsync(const char* path, std::function<void(StateMachineAsset)> onLoaded = nullptr);
+
+	template <typename Tag>
+	void Release(AssetHandle<Tag> handle) { ReleaseRecord(handle.index, handle.generation, Tag::type); }
+
+	template <typename Tag>
+	AssetState GetState(AssetHandle<Tag> handle) const
+	{
+		const AssetRecord* record = Resolve(handle.index, handle.generation, Tag::type);
+		return record != nullptr ? record->state : AssetState::INVALID;
+	}
+
+	// Loaded data, empty while loading or after a failure
+	TextureHandle GetTexture(TextureAsset asset) const;
+	int GetSound(SoundAsset asset) const;
+	const AnimationLibrary* GetAnimations(AnimationAsset asset) const;
+	const AnimationStateMachine* GetStateMachine(StateMachineAsset asset) const;
+
+	// Per-asset load time and memory
+	void GetStats(std::vector<AssetStats>& stats) const;
+	size_t GetTotalBytes() const;
+	void LogStats() const;
+
+private:
+
+	struct AssetRecord
+	{
+		AssetType type = AssetType::TEXTURE;
+		std::string key;
+		AssetState state = AssetState::INVALID;
+		int refCount = 0;
+		uint32_t generation = 1;
+		double loadMs = 0.0;
+		size_t bytes = 0;
+
+		TextureHandle texture;
+		int sound = 0;
+		std::unique_ptr<AnimationLibrary> animations;
+		std::unique_ptr<AnimationStateMachine> stateMachine;
+
+		std::vector<std::function<void()>> callbacks;
+	};
+
+	// Decoding work, filled on a worker and consumed on the main thread
+	struct LoadJob
+	{
+		AssetType type = AssetType::TEXTURE;
+		uint32_t index = 0;
+		uint32_t generation = 0;
+		std::string path;
+		std::unordered_map<int, std::string> aliases;
+
+		bool ok = false;
+		double decodeMs = 0.0;
+		Textures::DecodedImage image;
+		Audio::SoundData sound;
+		AnimationLibrary animations;
+		AnimationStateMachine stateMachine;
+	};
+
+	// Record of the key, created and queued on the first request
+	uint32_t Request(AssetType type, const std::string& key, const char* path,
+		const std::unordered_map<int, std::string>* aliases, bool async);
+	void AddCallback(uint32_t index, std::function<void()> callback);
+	void WaitFor(uint32_t index, uint32_t generation);
+
+	void RunJob(LoadJob& job) const;
+	void FinishJob(LoadJob& job);
+	void DiscardJob(LoadJob& job) const;
+	void FinishLoads();
+
+	void ReleaseRecord(uint32_t index, uint32_t generation, AssetType type);
+	void FreeRecord(AssetRecord& record);
+	AssetRecord* Resolve(uint32_t index, uint32_t generation, AssetType type);
+	const AssetRecord* Resolve(uint32_t index, uint32_t generation, AssetType type) const;
+
+	static std::string AnimationKey(const char* tsxPath, const std::unordered_map<int, std::string>& aliases);
+
+	// Worker threads
+	void StartWorkers();
+	void StopWorkers();
+	void WorkerLoop();
+
+private:
+
+	std::vector<AssetRecord> records;
+	std::vector<uint32_t> freeRecords;
+	std::unordered_map<std::string, uint32_t> keyIndex;
+
+	// Callbacks of assets that were already finished when requested
+	std::vector<std::function<void()>> pendingCallbacks;
+
+	// Threads decoding queued jobs, 0 decodes every load on the main thread
+	int workerCount = 2;
+	std::vector<std::thread> workers;
+	bool stopping = false;
+
+	std::mutex jobMutex;
+	std::condition_variable jobCondition;
+	std::deque<std::unique_ptr<LoadJob>> pendingJobs;
+
+	std::mutex doneMutex;
+	std::condition_variable doneCondition;
+	std::vector<std::unique_ptr<LoadJob>> doneJobs;
+	int jobsInFlight = 0; // main thread only: queued or running jobs
+};
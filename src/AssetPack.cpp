@@ -0,0 +1,180 @@
+#include "AssetPack.h"
+#include "PackCompression.h"
+#include "Engine.h"
+#include "Textures.h"
+#include "Log.h"
+
+#include <cstring>
+
+AssetPack::AssetPack() : Module()
+{
+	name = "pack";
+}
+
+// Destructor
+AssetPack::~AssetPack()
+{
+	Close();
+}
+
+// Called before render is available
+bool AssetPack::Awake()
+{
+	LOG("Loading Asset Pack");
+
+	if (!configParameters.attribute("enabled").as_bool(true)) return true;
+
+	// Without a pack every asset is read from the Assets folder
+	std::string path = configParameters.attribute("path").as_string("Assets.pak");
+	if (Open(path)) LOG("Asset pack %s: %u files", path.c_str(), header->entryCount);
+	else LOG("No asset pack at %s, reading loose files", path.c_str());
+
+	return true;
+}
+
+// Called before quitting
+bool AssetPack::CleanUp()
+{
+	// The mapping is released with the module: modules cleaned up later may still be reading from it
+	LOG("Freeing Asset Pack");
+	return true;
+}
+
+bool AssetPack::Open(const std::string& path)
+{
+	Close();
+	if (!file.Open(path)) return false;
+
+	const Uint8* base = file.GetData();
+	size_t fileSize = file.GetSize();
+	const PackHeader* candidate = (const PackHeader*)base;
+
+	if (fileSize < sizeof(PackHeader) || memcmp(candidate->magic, PACK_MAGIC, sizeof(candidate->magic)) != 0
+		|| candidate->version != PACK_VERSION
+		|| candidate->tocOffset > fileSize || (fileSize - candidate->tocOffset) / sizeof(PackEntry) < candidate->entryCount
+		|| candidate->namesOffset > fileSize)
+	{
+		LOG("Invalid asset pack %s", path.c_str());
+		file.Close();
+		return false;
+	}
+
+	entries = (const PackEntry*)(base + candidate->tocOffset);
+	names = (const char*)(base + candidate->namesOffset);
+	namesSize = fileSize - (size_t)candidate->namesOffset;
+
+	for (uint32_t i = 0; i < candidate->entryCount; ++i) {
+		const PackEntry& entry = entries[i];
+		if (entry.offset > fileSize || entry.size > fileSize - entry.offset || entry.nameOffset >= namesSize) {
+			LOG("Invalid asset pack %s: entry %u is out of bounds", path.c_str(), i);
+			file.Close();
+			entries = nullptr;
+			names = nullptr;
+			return false;
+		}
+	}
+
+	header = candidate;
+	return true;
+}
+
+void AssetPack::Close()
+{
+	file.Close();
+	header = nullptr;
+	entries = nullptr;
+	names = nullptr;
+	namesSize = 0;
+}
+
+const PackEntry* AssetPack::Find(const char* path) const
+{
+	if (header == nullptr) return nullptr;
+
+	std::string key = Textures::NormalizePath(path);
+	uint64_t hash = PackHashPath(key.c_str(), key.size());
+
+	// Lower bound on the sorted hashes, then compare names to rule out collisions
+	uint32_t low = 0;
+	uint32_t high = header->entryCount;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if (entries[middle].pathHash < hash) low = middle + 1;
+		else high = middle;
+	}
+
+	for (uint32_t i = low; i < header->entryCount && entries[i].pathHash == hash; ++i) {
+		const char* name = names + entries[i].nameOffset;
+		size_t available = namesSize - entries[i].nameOffset;
+		if (key.size() < available && memcmp(name, key.c_str(), key.size() + 1) == 0) return &entries[i];
+	}
+	return nullptr;
+}
+
+bool AssetPack::Read(const PackEntry& entry, const Uint8*& data, size_t& size, std::vector<Uint8>& inflated) const
+{
+	const Uint8* stored = file.GetData() + entry.offset;
+
+	if (entry.compression == PACK_STORED) {
+		data = stored;
+		size = (size_t)entry.size;
+		return true;
+	}
+
+	if (entry.compression != PACK_LZ) return false;
+
+	inflated.resize((size_t)entry.rawSize);
+	if (!PackDecompress(stored, (size_t)entry.size, inflated.data(), inflated.size())) return false;
+
+	data = inflated.data();
+	size = inflated.size();
+	return true;
+}
+
+SDL_IOStream* AssetPack::OpenStream(const PackEntry& entry) const
+{
+	if (entry.compression != PACK_STORED) return nullptr;
+	return SDL_IOFromConstMem(file.GetData() + entry.offset, (size_t)entry.size);
+}
+
+// ---------- AssetFile ----------
+
+AssetFile::AssetFile()
+{}
+
+// Destructor
+AssetFile::~AssetFile()
+{
+	Close();
+}
+
+bool AssetFile::Open(const char* path)
+{
+	Close();
+
+	const std::shared_ptr<AssetPack>& pack = Engine::GetInstance().pack;
+	const PackEntry* entry = pack != nullptr ? pack->Find(path) : nullptr;
+	if (entry != nullptr) {
+		if (pack->Read(*entry, data, size, inflated)) return true;
+		SDL_SetError("corrupt packed file %s", path);
+		data = nullptr;
+		size = 0;
+		return false;
+	}
+
+	if (!loose.Open(path)) {
+		SDL_SetError("cannot open %s", path);
+		return false;
+	}
+	data = loose.GetData();
+	size = loose.GetSize();
+	return true;
+}
+
+void AssetFile::Close()
+{
+	loose.Close();
+	std::vector<Uint8>().swap(inflated);
+	data = nullptr;
+	size = 0;
+}
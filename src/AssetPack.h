@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Module.h"
+#include "MappedFile.h"
+#include "AssetPackFormat.h"
+#include <SDL3/SDL.h>
+#include <string>
+#include <vector>
+
+// Read-only archive of the Assets folder, built by tools/AssetPacker.
+// The whole pack is memory-mapped once; packed files are views into the mapping, so loading
+// an asset does not open, seek nor read any file. Paths missing from the pack are read from disk.
+class AssetPack : public Module
+{
+public:
+
+	AssetPack();
+
+	// Destructor
+	virtual ~AssetPack();
+
+	// Called before render is available
+	bool Awake();
+
+	// Called before quitting
+	bool CleanUp();
+
+	bool Open(const std::string& path);
+	void Close();
+	bool IsOpen() const { return header != nullptr; }
+
+	// Table entry of a file, nullptr if it is not packed. Safe on any thread
+	const PackEntry* Find(const char* path) const;
+
+	// Bytes of an entry: points into the mapping, or into inflated for compressed entries
+	bool Read(const PackEntry& entry, const Uint8*& data, size_t& size, std::vector<Uint8>& inflated) const;
+
+	// Read-only stream over a stored entry without copying it, nullptr for compressed entries
+	SDL_IOStream* OpenStream(const PackEntry& entry) const;
+
+private:
+
+	MappedFile file;
+	const PackHeader* header = nullptr;
+	const PackEntry* entries = nullptr;
+	const char* names = nullptr;
+	size_t namesSize = 0;
+};
+
+// Bytes of an asset file, from the pack when it is packed and else mapped from disk.
+// Every loader reads through it so the same code serves loose and packed assets. Safe on worker threads
+class AssetFile
+{
+public:
+
+	AssetFile();
+
+	// Destructor
+	~AssetFile();
+
+	AssetFile(const AssetFile&) = delete;
+	AssetFile& operator=(const AssetFile&) = delete;
+
+	bool Open(const char* path);
+	void Close();
+
+	bool IsOpen() const { return data != nullptr; }
+	const Uint8* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+	// Read-only stream over the bytes, the caller closes it before the file
+	SDL_IOStream* OpenStream() const { return SDL_IOFromConstMem(data, size); }
+
+private:
+
+	MappedFile loose;
+	std::vector<Uint8> inflated;
+	const Uint8* data = nullptr;
+	size_t size = 0;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// On-disk layout of the asset pack, shared by the game and tools/AssetPacker.
+// [PackHeader][entry data, each aligned to PACK_ALIGNMENT][PackEntry x entryCount][path names]
+// Entries are sorted by path hash so a lookup is a binary search over the mapped table.
+
+#define PACK_MAGIC "APAK"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 64
+
+enum PackCompression : uint32_t
+{
+	PACK_STORED = 0,
+	PACK_LZ = 1  // LZ4 block format, see PackCompression.h
+};
+
+struct PackHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+	uint64_t tocOffset;
+	uint64_t namesOffset;
+};
+
+struct PackEntry
+{
+	uint64_t pathHash;
+	uint64_t offset;
+	uint64_t size;     // bytes stored in the pack
+	uint64_t rawSize;  // bytes once decompressed
+	uint32_t nameOffset;
+	uint32_t compression;
+};
+
+// FNV-1a of a normalized path: forward slashes, relative to the working directory
+inline uint64_t PackHashPath(const char* path, size_t length)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= (unsigned char)path[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
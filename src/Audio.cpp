@@ -1,4 +1,5 @@
 #include "Audio.h"
+#include "AssetPack.h"
 #include "Log.h"
 
 Audio::Audio() {
@@ -10,8 +11,15 @@ Audio::~Audio() {
 }
 
 bool Audio::LoadWavFile(const char* path, SoundData& out) {
-    // SDL_LoadWAV fills spec + allocates buf; free with SDL_free() later.
-    if (!SDL_LoadWAV(path, &out.spec, &out.buf, &out.len)) {
+    // Packed or loose, the WAV is parsed from memory
+    AssetFile file;
+    if (!file.Open(path)) {
+        SDL_Log("SDL_LoadWAV failed for %s: %s", path, SDL_GetError());
+        return false;
+    }
+
+    // SDL_LoadWAV_IO fills spec + allocates buf; free with SDL_free() later.
+    if (!SDL_LoadWAV_IO(file.OpenStream(), true, &out.spec, &out.buf, &out.len)) {
         SDL_Log("SDL_LoadWAV failed for %s: %s", path, SDL_GetError());
         return false;
     }
@@ -194,12 +202,29 @@ int Audio::LoadFx(const char* path) {
     return static_cast<int>(sfx_.size()); // 1-based outward index
 }
 
+int Audio::AddFx(SoundData& data) {
+    if (!active || data.buf == nullptr) {
+        FreeSound(data);
+        return 0;
+    }
+
+    sfx_.push_back(data);
+    data = SoundData{};
+    return static_cast<int>(sfx_.size()); // 1-based outward index
+}
+
+void Audio::UnLoadFx(int id) {
+    if (id <= 0 || id > static_cast<int>(sfx_.size())) return;
+    FreeSound(sfx_[static_cast<size_t>(id - 1)]);
+}
+
 bool Audio::PlayFx(int id, int repeat) {
     if (!active) return false;
     if (id <= 0 || id > static_cast<int>(sfx_.size())) return false;
     if (!EnsureStreams()) return false;
 
     const SoundData& s = sfx_[static_cast<size_t>(id - 1)];
+    if (s.buf == nullptr) return false; // unloaded
 
     // Make sure the SFX stream input format matches this sound
     if (!SDL_SetAudioStreamFormat(sfx_stream_, &s.spec, &device_spec_)) {
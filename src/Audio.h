@@ -33,14 +33,23 @@ public:
 	// Play a previously loaded WAV
 	bool PlayFx(int fx, int repeat = 0);
 
-private:
-
     struct SoundData {
         SDL_AudioSpec spec{};  // source format
         Uint8* buf{ nullptr };
         Uint32 len{ 0 };  // bytes
     };
 
+    // Decode a WAV without touching the device, safe on any thread
+    static bool LoadWavFile(const char* path, SoundData& out);
+    static void FreeSound(SoundData& s);
+
+    // Take ownership of an already decoded sound, returns its fx id (0 on failure)
+    int AddFx(SoundData& data);
+    // Free a fx, its id is not reused
+    void UnLoadFx(int fx);
+
+private:
+
     // Device and default output format
     SDL_AudioDeviceID device_{ 0 };
     SDL_AudioSpec     device_spec_{};
@@ -54,8 +63,6 @@ private:
     std::vector<SoundData> sfx_; // 1-based indexing outwardly
 
     // helpers
-    bool LoadWavFile(const char* path, SoundData& out);
-    void FreeSound(SoundData& s);
     bool EnsureDeviceOpen();
     bool EnsureStreams();
 };
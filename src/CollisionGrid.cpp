@@ -0,0 +1,176 @@
+#include "CollisionGrid.h"
+#include <cmath>
+#include <algorithm>
+
+static int PopCount(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountll(value);
+#else
+	value = value - ((value >> 1) & 0x5555555555555555ull);
+	value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+	value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return (int)((value * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+void CollisionGrid::Init(int width, int height, int tileWidth, int tileHeight)
+{
+	this->width = width;
+	this->height = height;
+	this->tileWidth = tileWidth > 0 ? tileWidth : 1;
+	this->tileHeight = tileHeight > 0 ? tileHeight : 1;
+	wordsPerRow = (width + 63) / 64;
+	bits.assign((size_t)wordsPerRow * height, 0);
+}
+
+void CollisionGrid::Clear()
+{
+	width = height = wordsPerRow = 0;
+	bits.clear();
+}
+
+void CollisionGrid::Set(int i, int j, bool solid)
+{
+	if ((unsigned)i >= (unsigned)height || (unsigned)j >= (unsigned)width) return;
+	uint64_t& word = bits[(size_t)i * wordsPerRow + (j >> 6)];
+	uint64_t mask = 1ull << (j & 63);
+	if (solid) word |= mask;
+	else word &= ~mask;
+}
+
+bool CollisionGrid::ClampRect(int& i0, int& j0, int& i1, int& j1) const
+{
+	if (i0 > i1) std::swap(i0, i1);
+	if (j0 > j1) std::swap(j0, j1);
+	i0 = std::max(i0, 0);
+	j0 = std::max(j0, 0);
+	i1 = std::min(i1, height - 1);
+	j1 = std::min(j1, width - 1);
+	return i0 <= i1 && j0 <= j1;
+}
+
+bool CollisionGrid::AnySolidInRow(int i, int j0, int j1) const
+{
+	int i1 = i;
+	if (!ClampRect(i, j0, i1, j1)) return false;
+
+	const uint64_t* row = &bits[(size_t)i * wordsPerRow];
+	int w0 = j0 >> 6;
+	int w1 = j1 >> 6;
+
+	if (w0 == w1) return (row[w0] & WordMask(j0 & 63, j1 & 63)) != 0;
+
+	if (row[w0] & WordMask(j0 & 63, 63)) return true;
+	for (int w = w0 + 1; w < w1; ++w) {
+		if (row[w] != 0) return true;
+	}
+	return (row[w1] & WordMask(0, j1 & 63)) != 0;
+}
+
+bool CollisionGrid::AnySolidInRect(int i0, int j0, int i1, int j1) const
+{
+	if (!ClampRect(i0, j0, i1, j1)) return false;
+	for (int i = i0; i <= i1; ++i) {
+		if (AnySolidInRow(i, j0, j1)) return true;
+	}
+	return false;
+}
+
+int CollisionGrid::CountSolidInRect(int i0, int j0, int i1, int j1) const
+{
+	if (!ClampRect(i0, j0, i1, j1)) return 0;
+
+	int count = 0;
+	int w0 = j0 >> 6;
+	int w1 = j1 >> 6;
+	for (int i = i0; i <= i1; ++i) {
+		const uint64_t* row = &bits[(size_t)i * wordsPerRow];
+		for (int w = w0; w <= w1; ++w) {
+			int from = (w == w0) ? (j0 & 63) : 0;
+			int to = (w == w1) ? (j1 & 63) : 63;
+			count += PopCount(row[w] & WordMask(from, to));
+		}
+	}
+	return count;
+}
+
+bool CollisionGrid::AnySolidInWorldRect(float x, float y, float w, float h) const
+{
+	if (w <= 0.0f || h <= 0.0f) return false;
+	int j0 = (int)std::floor(x / tileWidth);
+	int i0 = (int)std::floor(y / tileHeight);
+	// The right and bottom edges are exclusive
+	int j1 = (int)std::ceil((x + w) / tileWidth) - 1;
+	int i1 = (int)std::ceil((y + h) / tileHeight) - 1;
+	return AnySolidInRect(i0, j0, i1, j1);
+}
+
+// Amanatides & Woo traversal: visits every cell crossed by the segment in order
+CollisionGrid::RayHit CollisionGrid::RayCast(float x1, float y1, float x2, float y2) const
+{
+	RayHit result;
+	if (width == 0 || height == 0) return result;
+
+	float dx = x2 - x1;
+	float dy = y2 - y1;
+	float length = std::sqrt(dx * dx + dy * dy);
+
+	int j = (int)std::floor(x1 / tileWidth);
+	int i = (int)std::floor(y1 / tileHeight);
+	const int endJ = (int)std::floor(x2 / tileWidth);
+	const int endI = (int)std::floor(y2 / tileHeight);
+
+	if (IsSolid(i, j)) {
+		result.hit = true;
+		result.i = i;
+		result.j = j;
+		return result;
+	}
+	if (length <= 0.0f) return result;
+
+	const int stepJ = (dx > 0.0f) ? 1 : ((dx < 0.0f) ? -1 : 0);
+	const int stepI = (dy > 0.0f) ? 1 : ((dy < 0.0f) ? -1 : 0);
+
+	// Ray parameter t in [0, 1] along the segment
+	const float inf = 1e30f;
+	float tDeltaX = (stepJ != 0) ? tileWidth / std::fabs(dx) : inf;
+	float tDeltaY = (stepI != 0) ? tileHeight / std::fabs(dy) : inf;
+	float tMaxX = (stepJ > 0) ? ((j + 1) * tileWidth - x1) / dx : ((stepJ < 0) ? (j * tileWidth - x1) / dx : inf);
+	float tMaxY = (stepI > 0) ? ((i + 1) * tileHeight - y1) / dy : ((stepI < 0) ? (i * tileHeight - y1) / dy : inf);
+
+	while (i != endI || j != endJ) {
+		float t;
+		int normalX = 0;
+		int normalY = 0;
+		if (tMaxX < tMaxY) {
+			t = tMaxX;
+			tMaxX += tDeltaX;
+			j += stepJ;
+			normalX = -stepJ;
+		}
+		else {
+			t = tMaxY;
+			tMaxY += tDeltaY;
+			i += stepI;
+			normalY = -stepI;
+		}
+
+		if (t > 1.0f) break;
+
+		// Leaving the grid: nothing else can be hit in the ray direction
+		if (normalX != 0 ? (stepJ > 0 ? j >= width : j < 0) : (stepI > 0 ? i >= height : i < 0)) break;
+
+		if (IsSolid(i, j)) {
+			result.hit = true;
+			result.i = i;
+			result.j = j;
+			result.distance = t * length;
+			result.normalX = normalX;
+			result.normalY = normalY;
+			return result;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Packed occupancy grid of the map collision layer, one bit per cell.
+// Rows are padded to whole 64-bit words so row and rect scans test 64 cells at a time.
+class CollisionGrid
+{
+public:
+
+	struct RayHit
+	{
+		bool hit = false;
+		int i = -1;            // row of the solid cell
+		int j = -1;            // column of the solid cell
+		float distance = 0.0f; // pixels from the ray origin to the cell boundary
+		int normalX = 0;       // face of the cell the ray entered through
+		int normalY = 0;
+	};
+
+	CollisionGrid() {}
+
+	void Init(int width, int height, int tileWidth, int tileHeight);
+	void Clear();
+
+	void Set(int i, int j, bool solid);
+
+	// Cell tests, cells outside the grid are not solid
+	bool IsSolid(int i, int j) const
+	{
+		if ((unsigned)i >= (unsigned)height || (unsigned)j >= (unsigned)width) return false;
+		return (bits[(size_t)i * wordsPerRow + (j >> 6)] >> (j & 63)) & 1u;
+	}
+
+	// Point test in world pixels
+	bool IsSolidAt(float x, float y) const
+	{
+		if (x < 0.0f || y < 0.0f) return false;
+		return IsSolid((int)y / tileHeight, (int)x / tileWidth);
+	}
+
+	// Any solid cell in row i between columns j0 and j1, both included
+	bool AnySolidInRow(int i, int j0, int j1) const;
+	// Any solid cell in the cell rectangle [i0,i1] x [j0,j1]
+	bool AnySolidInRect(int i0, int j0, int i1, int j1) const;
+	// Number of solid cells in the cell rectangle [i0,i1] x [j0,j1]
+	int CountSolidInRect(int i0, int j0, int i1, int j1) const;
+	// Any solid cell overlapping a rectangle in world pixels
+	bool AnySolidInWorldRect(float x, float y, float w, float h) const;
+
+	// Grid DDA from (x1,y1) to (x2,y2) in world pixels, stops at the first solid cell
+	RayHit RayCast(float x1, float y1, float x2, float y2) const;
+	bool LineOfSight(float x1, float y1, float x2, float y2) const
+	{
+		return !RayCast(x1, y1, x2, y2).hit;
+	}
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	int GetTileWidth() const { return tileWidth; }
+	int GetTileHeight() const { return tileHeight; }
+
+private:
+
+	// Mask of the bits of columns [j0, j1] inside one word, j0 and j1 in [0, 63]
+	static uint64_t WordMask(int j0, int j1)
+	{
+		uint64_t high = (j1 >= 63) ? ~0ull : ((1ull << (j1 + 1)) - 1);
+		return high & (~0ull << j0);
+	}
+
+	// Clamp a cell rectangle to the grid, returns false if nothing is left
+	bool ClampRect(int& i0, int& j0, int& i1, int& j1) const;
+
+	int width = 0;
+	int height = 0;
+	int tileWidth = 1;
+	int tileHeight = 1;
+	int wordsPerRow = 0;
+	std::vector<uint64_t> bits;
+};
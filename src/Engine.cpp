@@ -3,15 +3,19 @@
 #include <iomanip>
 
 #include "Engine.h"
+#include "AssetPack.h"
 #include "Window.h"
 #include "Input.h"
 #include "Render.h"
 #include "Textures.h"
 #include "Audio.h"
+#include "AssetManager.h"
 #include "Scene.h"
 #include "EntityManager.h"
 #include "Map.h"
+#include "AnimationSystem.h"
 #include "Physics.h"
+#include "Pathfinding.h"
 #include "Log.h"
 #include "Player.h" // para castear a Player
 
@@ -30,28 +34,37 @@ Engine::Engine() {
     // L4: TODO 1: Add the EntityManager Module to the Engine
 
     // Modules
+    pack = std::make_shared<AssetPack>();
     window = std::make_shared<Window>();
     input = std::make_shared<Input>();
     render = std::make_shared<Render>();
     textures = std::make_shared<Textures>();
     audio = std::make_shared<Audio>();
+    assets = std::make_shared<AssetManager>();
     // L08: TODO 2: Add Physics module
     physics = std::make_shared<Physics>();
     scene = std::make_shared<Scene>();
     map = std::make_shared<Map>();
+    animations = std::make_shared<AnimationSystem>();
     entityManager = std::make_shared<EntityManager>();
+    pathfinding = std::make_shared<Pathfinding>();
 
     // Ordered for awake / Start / Update
     // Reverse order of CleanUp
+    AddModule(std::static_pointer_cast<Module>(pack));
     AddModule(std::static_pointer_cast<Module>(window));
     AddModule(std::static_pointer_cast<Module>(input));
     AddModule(std::static_pointer_cast<Module>(textures));
     AddModule(std::static_pointer_cast<Module>(audio));
+    AddModule(std::static_pointer_cast<Module>(assets));
     // L08: TODO 2: Add Physics module
     AddModule(std::static_pointer_cast<Module>(physics));
     AddModule(std::static_pointer_cast<Module>(map));
+    // Animations advance before the entities draw them
+    AddModule(std::static_pointer_cast<Module>(animations));
     AddModule(std::static_pointer_cast<Module>(scene));
     AddModule(std::static_pointer_cast<Module>(entityManager));
+    AddModule(std::static_pointer_cast<Module>(pathfinding));
 
     // Render last 
     AddModule(std::static_pointer_cast<Module>(render));
@@ -298,21 +311,11 @@ void Engine::HandleDebugKeys()
     if (input->GetKey(SDL_SCANCODE_H) == KEY_DOWN)
         showHelp = !showHelp;
 
-    // F10: God Mode -> localizar Player en EntityManager y hacer toggle
+    // F10: God Mode -> resolver el handle del Player de la escena y hacer toggle
     if (input->GetKey(SDL_SCANCODE_F10) == KEY_DOWN)
     {
-        if (entityManager)
-        {
-            for (const auto& e : entityManager->entities)
-            {
-                if (e && e->type == EntityType::PLAYER)
-                {
-                    Player* p = dynamic_cast<Player*>(e.get());
-                    if (p) { p->ToggleGodMode(); }
-                    break;
-                }
-            }
-        }
+        Player* player = (entityManager && scene) ? entityManager->players.Get(scene->GetPlayer()) : nullptr;
+        if (player) { player->ToggleGodMode(); }
     }
 
     // F11: 30 FPS cap toggle
@@ -8,16 +8,20 @@
 #include "pugixml.hpp"
 
 // Modules
+class AssetPack;
 class Window;
 class Input;
 class Render;
 class Textures;
 class Audio;
+class AssetManager;
 class Scene;
 class EntityManager;
 class Map;
+class AnimationSystem;
 //L08 TODO 2: Add Physics module
 class Physics;
+class Pathfinding;
 
 class Engine
 {
@@ -98,17 +102,21 @@ public:
 	};
 
 	// Modules
+	std::shared_ptr<AssetPack> pack;
 	std::shared_ptr<Window> window;
 	std::shared_ptr<Input> input;
 	std::shared_ptr<Render> render;
 	std::shared_ptr<Textures> textures;
 	std::shared_ptr<Audio> audio;
+	std::shared_ptr<AssetManager> assets;
 	std::shared_ptr<Scene> scene;
 	// L04: TODO 1: Add the EntityManager Module to the Engine
 	std::shared_ptr<EntityManager> entityManager;
 	std::shared_ptr<Map> map;
+	std::shared_ptr<AnimationSystem> animations;
 	// L08: TODO 2: Add Physics module
 	std::shared_ptr<Physics> physics;
+	std::shared_ptr<Pathfinding> pathfinding;
 
 
 private:
@@ -10,9 +10,21 @@ enum class EntityType
 	UNKNOWN
 };
 
+// Reference to an entity, stale once it is destroyed
+struct EntityHandle
+{
+	uint32_t index = 0;
+	uint32_t generation = 0; // never a live generation
+	EntityType type = EntityType::UNKNOWN;
+
+	bool IsValid() const { return generation != 0; }
+	bool operator==(const EntityHandle& other) const { return index == other.index && generation == other.generation && type == other.type; }
+	bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
 class PhysBody;
 
-class Entity : public std::enable_shared_from_this<Entity>
+class Entity
 {
 public:
 
@@ -34,6 +46,22 @@ public:
 		return true;
 	}
 
+	// Batch update of the entities of one type, called by their pool once per frame.
+	// The default calls T::Update without virtual dispatch so it can be inlined into the loop;
+	// a type hides it with its own static UpdateAll to process its entities in a tighter loop
+	template <typename T>
+	static bool UpdateAll(T* const* entities, int count, float dt)
+	{
+		bool ret = true;
+		for (int i = 0; i < count; ++i)
+		{
+			T* entity = entities[i];
+			if (entity->active == false || entity->pendingToDestroy || !entity->tickThisFrame) continue;
+			if (!entity->T::Update(entity->tickDt)) ret = false;
+		}
+		return ret;
+	}
+
 	virtual bool CleanUp()
 	{
 		return true;
@@ -75,6 +103,22 @@ public:
 	std::string name;
 	EntityType type;
 	bool active = true;
+	// Set by the entity manager when it creates the entity
+	EntityHandle handle;
+	// Destruction requested, the entity is no longer updated and goes away in the next PreUpdate
+	bool pendingToDestroy = false;
+	// Bucket in the entity manager spatial hash, -1 when not in it
+	uint64_t spatialCell = 0;
+	int spatialIndex = -1;
+
+	// Update rate set by the entity manager from the distance to the player: frames between
+	// updates, 0 while suspended. tickDt is the time since the last update when it ticks, capped
+	// at the manager maxResumeDt on the first update after a suspension
+	int tickInterval = 1;
+	bool tickThisFrame = true;
+	bool resuming = false;
+	float tickDt = 0.0f;
+	float accumulatedDt = 0.0f;
 
 	// Possible properties, it depends on how generic we
 	// want our Entity class, maybe it's not renderable...
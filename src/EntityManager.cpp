@@ -5,6 +5,10 @@
 #include "Scene.h"
 #include "Log.h"
 #include "Item.h"
+#include "Map.h"
+#include "Window.h"
+
+#include <algorithm>
 
 EntityManager::EntityManager() : Module()
 {
@@ -21,11 +25,24 @@ bool EntityManager::Awake()
 	LOG("Loading Entity Manager");
 	bool ret = true;
 
+	spatialHash.Init(configParameters.child("spatialHash").attribute("cellSize").as_int(128));
+
+	pugi::xml_node lod = configParameters.child("tickLod");
+	tickLod = lod.attribute("enabled").as_bool(tickLod);
+	nearDistance = lod.attribute("near").as_float(nearDistance);
+	farDistance = lod.attribute("far").as_float(farDistance);
+	mediumInterval = std::max(1, lod.attribute("mediumInterval").as_int(mediumInterval));
+	maxResumeDt = lod.attribute("maxResumeDt").as_float(maxResumeDt);
+
 	//Iterates over the entities and calls the Awake
-	for(const auto entity : entities)
+	for (EntityPoolBase* pool : pools)
 	{
-		if (entity->active == false) continue;
-		ret = entity->Awake();
+		for (int i = 0; i < pool->GetCount(); ++i)
+		{
+			Entity* entity = pool->GetEntity(i);
+			if (entity->active == false) continue;
+			ret = entity->Awake();
+		}
 	}
 
 	return ret;
@@ -37,71 +54,250 @@ bool EntityManager::Start() {
 	bool ret = true; 
 
 	//Iterates over the entities and calls Start
-	for(const auto entity : entities)
+	for (EntityPoolBase* pool : pools)
 	{
-		if (entity->active == false) continue;
-		ret = entity->Start();
+		for (int i = 0; i < pool->GetCount(); ++i)
+		{
+			Entity* entity = pool->GetEntity(i);
+			if (entity->active == false) continue;
+			ret = entity->Start();
+		}
 	}
 
+	UpdateSpatialHash();
+
 	return ret;
 }
 
+// Called each loop iteration, after the physics step dispatched its collisions
+bool EntityManager::PreUpdate()
+{
+	DestroyPendingEntities();
+	return true;
+}
+
 // Called before quitting
 bool EntityManager::CleanUp()
 {
 	bool ret = true;
 
-	for(const auto entity : entities)
+	DestroyPendingEntities();
+	spatialHash.Clear();
+	visibleEntities.clear();
+
+	for (EntityPoolBase* pool : pools)
 	{
-		if (entity->active == false) continue;
-		ret = entity->CleanUp();
+		for (int i = 0; i < pool->GetCount(); ++i)
+		{
+			Entity* entity = pool->GetEntity(i);
+			if (entity->active == false) continue;
+			ret = entity->CleanUp();
+		}
+		pool->Clear();
 	}
 
-	entities.clear();
-
 	return ret;
 }
 
-std::shared_ptr<Entity> EntityManager::CreateEntity(EntityType type)
+Entity* EntityManager::CreateEntity(EntityType type)
 {
-	std::shared_ptr<Entity> entity = std::make_shared<Entity>();
+	//L04: TODO 3a: Instantiate entity according to the type in the pool of its type
+	EntityPoolBase* pool = GetPool(type);
+	if (pool == nullptr) return nullptr;
 
-	//L04: TODO 3a: Instantiate entity according to the type and add the new entity to the list of Entities
-	switch (type)
-	{
-	case EntityType::PLAYER:
-		entity = std::make_shared<Player>();
-		break;
-	case EntityType::ITEM:
-		entity = std::make_shared<Item>();
-		break;
-	default:
-		break;
+	return pool->CreateEntity();
+}
+
+void EntityManager::DestroyEntity(EntityHandle handle)
+{
+	Entity* entity = GetEntity(handle);
+	if (entity == nullptr || entity->pendingToDestroy) return;
+
+	entity->pendingToDestroy = true;
+	pendingDestroy.push_back(handle);
+}
+
+void EntityManager::DestroyPendingEntities()
+{
+	if (pendingDestroy.empty()) return;
+
+	// Release the bodies, textures and sounds of all of them first, then compact the pools.
+	// Entities queued by these CleanUp calls are freed in the same pass
+	for (size_t i = 0; i < pendingDestroy.size(); ++i) {
+		Entity* entity = GetEntity(pendingDestroy[i]);
+		if (entity != nullptr) entity->CleanUp();
+	}
+	for (const EntityHandle& handle : pendingDestroy) {
+		EntityPoolBase* pool = GetPool(handle.type);
+		spatialHash.Remove(pool->Get(handle));
+		pool->Destroy(handle);
 	}
 
-	entities.push_back(entity);
+	pendingDestroy.clear();
+}
 
-	return entity;
+Entity* EntityManager::GetEntity(EntityHandle handle) const
+{
+	EntityPoolBase* pool = GetPool(handle.type);
+	return pool != nullptr ? pool->Get(handle) : nullptr;
 }
 
-void EntityManager::DestroyEntity(std::shared_ptr<Entity> entity)
+EntityPoolBase* EntityManager::GetPool(EntityType type) const
 {
-	entity->CleanUp();
-	entities.remove(entity);
+	if ((unsigned)type >= (unsigned)EntityType::UNKNOWN) return nullptr;
+	return pools[(int)type];
 }
 
-void EntityManager::AddEntity(std::shared_ptr<Entity> entity)
+int EntityManager::SpawnFromObjectLayers(const std::list<MapObjectLayer*>& objectLayers)
 {
-	if ( entity != nullptr) entities.push_back(entity);
+	// Object types are interned by the map, resolve the ones we spawn only once
+	const int itemType = Properties::Intern("Item");
+	const int coinType = Properties::Intern("Coin");
+	const int playerType = Properties::Intern("Player");
+	const int textureKey = Properties::Intern("texture");
+
+	int spawned = 0;
+
+	for (const auto& objectLayer : objectLayers)
+	{
+		for (const MapObject& object : objectLayer->objects)
+		{
+			if (object.type == itemType || object.type == coinType)
+			{
+				Item* item = items.Create();
+				item->position = Vector2D(object.x, object.y);
+
+				const std::string& texturePath = object.properties.GetString(textureKey);
+				if (!texturePath.empty()) item->texturePath = texturePath;
+
+				// The entity manager was already awoken, Start runs with the rest of the entities
+				item->Awake();
+
+				spawned++;
+			}
+			else if (object.type == playerType)
+			{
+				// The player already exists, the object only marks where it starts
+				if (players.GetCount() > 0)
+				{
+					players[0]->position = Vector2D(object.x + object.width / 2, object.y + object.height / 2);
+				}
+			}
+		}
+	}
+
+	LOG("Spawned %d entities from map objects", spawned);
+
+	UpdateSpatialHash();
+
+	return spawned;
 }
 
 bool EntityManager::Update(float dt)
 {
+	UpdateTickRates(dt);
+
+	// One call per type, a failed phase does not stop the next ones
 	bool ret = true;
-	for(const auto entity : entities)
+	for (EntityType type : updateOrder)
 	{
-		if (entity->active == false) continue;
-		ret = entity->Update(dt);
+		if (!GetPool(type)->UpdateAll(dt)) ret = false;
 	}
+
+	UpdateSpatialHash();
+
 	return ret;
+}
+
+// Positions are written directly by the entities, so the moves are picked up here once per frame.
+// Only the entities that changed cell touch the hash
+void EntityManager::UpdateSpatialHash()
+{
+	for (EntityPoolBase* pool : pools)
+	{
+		for (int i = 0; i < pool->GetCount(); ++i)
+		{
+			Entity* entity = pool->GetEntity(i);
+			if (entity->pendingToDestroy) continue;
+			spatialHash.Update(entity);
+		}
+	}
+}
+
+void EntityManager::UpdateTickRates(float dt)
+{
+	frameCount++;
+
+	// Distances from the player, or from the camera center before there is one
+	Vector2D focus;
+	Player* player = players.Get(Engine::GetInstance().scene->GetPlayer());
+	if (player != nullptr) {
+		focus = player->position;
+	}
+	else {
+		const SDL_Rect& camera = Engine::GetInstance().render->camera;
+		float scale = (float)Engine::GetInstance().window->GetScale();
+		focus = Vector2D((-camera.x + camera.w / 2) / scale, (-camera.y + camera.h / 2) / scale);
+	}
+
+	const float nearSq = nearDistance * nearDistance;
+	const float farSq = farDistance * farDistance;
+
+	for (EntityPoolBase* pool : pools)
+	{
+		for (int i = 0; i < pool->GetCount(); ++i)
+		{
+			Entity* entity = pool->GetEntity(i);
+			entity->accumulatedDt += dt;
+
+			// The player draws itself and moves the camera, it always updates
+			int interval = 1;
+			if (tickLod && entity->type != EntityType::PLAYER) {
+				float dx = entity->position.getX() - focus.getX();
+				float dy = entity->position.getY() - focus.getY();
+				float distanceSq = dx * dx + dy * dy;
+				if (distanceSq > farSq) interval = 0;
+				else if (distanceSq > nearSq) interval = mediumInterval;
+			}
+			entity->tickInterval = interval;
+
+			// Near and medium entities get all the time since their last update. Suspended entities keep
+			// accumulating, but their first update after resuming is capped at maxResumeDt so physics and
+			// animations do not jump over the whole time they missed
+			if (interval == 0) entity->resuming = true;
+			entity->tickThisFrame = interval != 0 && (frameCount + entity->handle.index) % interval == 0;
+			if (entity->tickThisFrame) {
+				entity->tickDt = entity->accumulatedDt;
+				if (entity->resuming) entity->tickDt = std::min(entity->tickDt, maxResumeDt);
+				entity->resuming = false;
+				entity->accumulatedDt = 0.0f;
+			}
+		}
+	}
+}
+
+void EntityManager::QueryRect(float x, float y, float width, float height, std::vector<Entity*>& result, EntityType type) const
+{
+	spatialHash.QueryRect(x, y, width, height, result, type);
+}
+
+void EntityManager::QueryRadius(float x, float y, float radius, std::vector<Entity*>& result, EntityType type) const
+{
+	spatialHash.QueryRadius(x, y, radius, result, type);
+}
+
+void EntityManager::QueryVisible(std::vector<Entity*>& result, float margin, EntityType type) const
+{
+	// Same view as Render::DrawStreamedImage, the camera is the negated scroll in screen pixels
+	const SDL_Rect& camera = Engine::GetInstance().render->camera;
+	float scale = (float)Engine::GetInstance().window->GetScale();
+	spatialHash.QueryRect(-camera.x / scale - margin, -camera.y / scale - margin,
+		camera.w / scale + margin * 2.0f, camera.h / scale + margin * 2.0f, result, type);
+}
+
+const std::vector<Entity*>& EntityManager::QueryVisible(float margin, EntityType type)
+{
+	visibleEntities.clear();
+	QueryVisible(visibleEntities, margin, type);
+	return visibleEntities;
 }
\ No newline at end of file
@@ -2,7 +2,14 @@
 
 #include "Module.h"
 #include "Entity.h"
+#include "EntityPool.h"
+#include "Player.h"
+#include "Item.h"
+#include "SpatialHash.h"
 #include <list>
+#include <vector>
+
+struct MapObjectLayer;
 
 class EntityManager : public Module
 {
@@ -19,6 +26,9 @@ public:
 	// Called after Awake
 	bool Start();
 
+	// Called each loop iteration
+	bool PreUpdate();
+
 	// Called every frame
 	bool Update(float dt);
 
@@ -26,14 +36,69 @@ public:
 	bool CleanUp();
 
 	// Additional methods
-	std::shared_ptr<Entity> CreateEntity(EntityType type);
+	Entity* CreateEntity(EntityType type);
+
+	// Queues the entity for destruction, safe from collision callbacks and entity updates
+	void DestroyEntity(EntityHandle handle);
+
+	// Entity of the handle, nullptr once it was destroyed
+	Entity* GetEntity(EntityHandle handle) const;
+
+	// Spawn the entities placed in the map object layers in a single pass, returns how many were created
+	int SpawnFromObjectLayers(const std::list<MapObjectLayer*>& objectLayers);
+
+	// Entities by position, as of the end of the last update. Results are appended and only
+	// valid until the next destruction pass. EntityType::UNKNOWN matches every type
+	void QueryRect(float x, float y, float width, float height, std::vector<Entity*>& result, EntityType type = EntityType::UNKNOWN) const;
+	void QueryRadius(float x, float y, float radius, std::vector<Entity*>& result, EntityType type = EntityType::UNKNOWN) const;
+	// Entities inside the camera view grown by margin pixels on each side
+	void QueryVisible(std::vector<Entity*>& result, float margin = 0.0f, EntityType type = EntityType::UNKNOWN) const;
+	// Same query into a buffer owned by the manager, valid until the next call
+	const std::vector<Entity*>& QueryVisible(float margin = 0.0f, EntityType type = EntityType::UNKNOWN);
+
+private:
+
+	EntityPoolBase* GetPool(EntityType type) const;
 
-	void DestroyEntity(std::shared_ptr<Entity> entity);
+	// Cleans up and frees every entity queued by DestroyEntity
+	void DestroyPendingEntities();
 
-	void AddEntity(std::shared_ptr<Entity> entity);
+	// Moves the entities whose position changed cell, adding the new ones
+	void UpdateSpatialHash();
+
+	// Picks the entities that update this frame from their distance to the player
+	void UpdateTickRates(float dt);
 
 public:
 
-	std::list<std::shared_ptr<Entity>> entities;
+	// One pool per entity type, each stores its entities contiguously
+	EntityPool<Player> players{ EntityType::PLAYER };
+	EntityPool<Item> items{ EntityType::ITEM };
+
+private:
+
+	// Indexed by EntityType, in the order entities are awoken and started
+	EntityPoolBase* pools[(int)EntityType::UNKNOWN] = { &players, &items };
+
+	// Update phases, one batch per type in this order every frame.
+	// The player moves first so the items react to its position of this frame
+	static constexpr EntityType updateOrder[] = { EntityType::PLAYER, EntityType::ITEM };
+
+	std::vector<EntityHandle> pendingDestroy;
+
+	SpatialHash spatialHash;
+
+	// Reused by QueryVisible so drawing the visible entities does not allocate every frame
+	std::vector<Entity*> visibleEntities;
+
+	// Update LOD: full rate within nearDistance, every mediumInterval frames up to farDistance,
+	// suspended beyond. Entities of the same rate are spread over the frames by their slot.
+	// maxResumeDt caps the first update after a suspension, in ms
+	bool tickLod = true;
+	float nearDistance = 1024.0f;
+	float farDistance = 2560.0f;
+	int mediumInterval = 4;
+	float maxResumeDt = 100.0f;
+	uint32_t frameCount = 0;
 
 };
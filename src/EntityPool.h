@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Entity.h"
+#include <vector>
+#include <memory>
+#include <new>
+#include <cstdint>
+
+// Type-erased view of a pool, used by the entity manager for the calls every entity gets
+class EntityPoolBase
+{
+public:
+
+	virtual ~EntityPoolBase() {}
+
+	virtual Entity* CreateEntity() = 0;
+	virtual void Destroy(EntityHandle handle) = 0;
+	virtual Entity* Get(EntityHandle handle) const = 0;
+	virtual Entity* GetEntity(int dense) const = 0;
+	virtual int GetCount() const = 0;
+	virtual void Clear() = 0;
+
+	// Updates every entity of the pool, returns false if any update failed
+	virtual bool UpdateAll(float dt) = 0;
+};
+
+// Storage of every entity of one concrete type.
+// Entities live in fixed-size chunks so their address never changes while they are alive, and
+// live entities are listed in a packed array for iteration. Freed slots are reused, so once the
+// pool has grown creating and destroying entities does not allocate.
+template <typename T>
+class EntityPool : public EntityPoolBase
+{
+public:
+
+	static const int CHUNK_SIZE = 64;
+
+	EntityPool(EntityType type) : type(type) {}
+	~EntityPool() { Clear(); }
+
+	EntityPool(const EntityPool&) = delete;
+	EntityPool& operator=(const EntityPool&) = delete;
+
+	T* Create()
+	{
+		uint32_t slot;
+		if (!freeSlots.empty()) {
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else {
+			slot = (uint32_t)slotToDense.size();
+			if (slot % CHUNK_SIZE == 0) chunks.emplace_back(new Chunk());
+			slotToDense.push_back(-1);
+			slotGenerations.push_back(1);
+		}
+
+		T* entity = new (Slot(slot)) T();
+		entity->handle = EntityHandle{ slot, slotGenerations[slot], type };
+
+		slotToDense[slot] = (int)dense.size();
+		dense.push_back(entity);
+		return entity;
+	}
+
+	void Destroy(EntityHandle handle) override
+	{
+		T* entity = Get(handle);
+		if (entity == nullptr) return;
+
+		// Move the last entity into the hole to keep the list packed
+		int index = slotToDense[handle.index];
+		T* last = dense.back();
+		dense[index] = last;
+		slotToDense[last->handle.index] = index;
+		dense.pop_back();
+
+		entity->~T();
+		slotToDense[handle.index] = -1;
+		if (++slotGenerations[handle.index] == 0) slotGenerations[handle.index] = 1;
+		freeSlots.push_back(handle.index);
+	}
+
+	// Entity of the handle, nullptr once it was destroyed
+	T* Get(EntityHandle handle) const override
+	{
+		if (handle.type != type || handle.index >= slotToDense.size()) return nullptr;
+		if (slotGenerations[handle.index] != handle.generation || slotToDense[handle.index] < 0) return nullptr;
+		return dense[slotToDense[handle.index]];
+	}
+
+	Entity* CreateEntity() override { return Create(); }
+	Entity* GetEntity(int index) const override { return dense[index]; }
+	int GetCount() const override { return (int)dense.size(); }
+
+	bool UpdateAll(float dt) override { return T::UpdateAll(dense.data(), (int)dense.size(), dt); }
+
+	// Live entities in packed order, destroying one moves the last into its place
+	T* operator[](int index) const { return dense[index]; }
+
+	// Destroys every entity, the chunks are kept for reuse
+	void Clear() override
+	{
+		while (!dense.empty()) Destroy(dense.back()->handle);
+	}
+
+private:
+
+	struct Chunk
+	{
+		alignas(T) unsigned char storage[CHUNK_SIZE * sizeof(T)];
+	};
+
+	void* Slot(uint32_t slot) const
+	{
+		return chunks[slot / CHUNK_SIZE]->storage + (slot % CHUNK_SIZE) * sizeof(T);
+	}
+
+private:
+
+	EntityType type;
+	std::vector<std::unique_ptr<Chunk>> chunks;
+	std::vector<T*> dense;
+	std::vector<int> slotToDense;
+	std::vector<uint32_t> slotGenerations;
+	std::vector<uint32_t> freeSlots;
+};
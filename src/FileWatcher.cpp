@@ -0,0 +1,124 @@
+#include "FileWatcher.h"
+#include "Log.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0) LOG("FileWatcher: inotify unavailable, falling back to polling");
+#endif
+}
+
+// Destructor
+FileWatcher::~FileWatcher()
+{
+	Clear();
+#ifdef __linux__
+	if (inotifyFd >= 0) close(inotifyFd);
+#endif
+}
+
+bool FileWatcher::Watch(const std::string& path)
+{
+	for (const auto& file : files) {
+		if (file.path == path) return true;
+	}
+
+	WatchedFile file;
+	file.path = path;
+	file.modifyTime = ReadModifyTime(path);
+
+	if (file.modifyTime == 0) {
+		LOG("FileWatcher: cannot watch missing file %s", path.c_str());
+		return false;
+	}
+
+	size_t slash = path.find_last_of("/\\");
+	std::string dir = (slash == std::string::npos) ? "." : path.substr(0, slash);
+	file.fileName = (slash == std::string::npos) ? path : path.substr(slash + 1);
+
+#ifdef __linux__
+	// Watch the directory: editors usually save by replacing the file, which would drop a file watch
+	if (inotifyFd >= 0) {
+		file.watchId = inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (file.watchId < 0) LOG("FileWatcher: inotify_add_watch failed for %s (errno %d)", dir.c_str(), errno);
+	}
+#endif
+
+	files.push_back(file);
+	return true;
+}
+
+void FileWatcher::Clear()
+{
+#ifdef __linux__
+	if (inotifyFd >= 0) {
+		// Several files can share a directory watch, remove each one once
+		for (size_t i = 0; i < files.size(); ++i) {
+			if (files[i].watchId < 0) continue;
+			bool removed = false;
+			for (size_t j = 0; j < i; ++j) {
+				if (files[j].watchId == files[i].watchId) { removed = true; break; }
+			}
+			if (!removed) inotify_rm_watch(inotifyFd, files[i].watchId);
+		}
+	}
+#endif
+	files.clear();
+}
+
+bool FileWatcher::Poll(std::vector<std::string>& changed)
+{
+	size_t before = changed.size();
+
+#ifdef __linux__
+	if (inotifyFd >= 0) {
+		alignas(inotify_event) char buffer[4096];
+		ssize_t len;
+		while ((len = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+			for (char* ptr = buffer; ptr < buffer + len; ptr += sizeof(inotify_event) + ((inotify_event*)ptr)->len) {
+				const inotify_event* event = (const inotify_event*)ptr;
+				if (event->len == 0) continue;
+				for (auto& file : files) {
+					if (file.watchId == event->wd && file.fileName == event->name) {
+						bool queued = false;
+						for (size_t k = before; k < changed.size(); ++k) {
+							if (changed[k] == file.path) { queued = true; break; }
+						}
+						if (!queued) changed.push_back(file.path);
+					}
+				}
+			}
+		}
+	}
+#endif
+
+	// Files without a native watch are checked by modification time
+	Uint64 now = SDL_GetTicks();
+	if (now - lastPollMs >= pollIntervalMs) {
+		lastPollMs = now;
+		for (auto& file : files) {
+			if (file.watchId >= 0) continue;
+			SDL_Time modifyTime = ReadModifyTime(file.path);
+			if (modifyTime != 0 && modifyTime != file.modifyTime) {
+				file.modifyTime = modifyTime;
+				changed.push_back(file.path);
+			}
+		}
+	}
+
+	return changed.size() > before;
+}
+
+SDL_Time FileWatcher::ReadModifyTime(const std::string& path)
+{
+	SDL_PathInfo info;
+	if (!SDL_GetPathInfo(path.c_str(), &info)) return 0;
+	return info.modify_time;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <string>
+#include <vector>
+
+// Reports modifications of a set of files.
+// Uses inotify on Linux and polls the modification time elsewhere.
+class FileWatcher
+{
+public:
+
+	FileWatcher();
+
+	// Destructor
+	~FileWatcher();
+
+	// Start watching a file, returns false if it cannot be watched
+	bool Watch(const std::string& path);
+
+	// Stop watching every file
+	void Clear();
+
+	// Append to changed the watched files modified since the last call
+	bool Poll(std::vector<std::string>& changed);
+
+	bool Empty() const { return files.empty(); }
+
+private:
+
+	struct WatchedFile
+	{
+		std::string path;
+		std::string fileName;
+		SDL_Time modifyTime = 0;
+		int watchId = -1;
+	};
+
+	static SDL_Time ReadModifyTime(const std::string& path);
+
+	std::vector<WatchedFile> files;
+
+	// Fallback polling interval
+	Uint64 pollIntervalMs = 500;
+	Uint64 lastPollMs = 0;
+
+	int inotifyFd = -1;
+};
@@ -2,6 +2,7 @@
 #include "Engine.h"
 #include "Textures.h"
 #include "Audio.h"
+#include "AssetManager.h"
 #include "Input.h"
 #include "Render.h"
 #include "Scene.h"
@@ -22,8 +23,9 @@ bool Item::Awake() {
 
 bool Item::Start() {
 
-	//initilize textures
-	texture = Engine::GetInstance().textures->Load("Assets/Textures/goldCoin.png");
+	//initilize textures, every item using the same image shares one texture
+	textureAsset = Engine::GetInstance().assets->LoadTexture(texturePath.c_str());
+	texture = Engine::GetInstance().assets->GetTexture(textureAsset);
 	
 	// L08 TODO 4: Add a physics to an item - initialize the physics body
 	Engine::GetInstance().textures.get()->GetSize(texture, texW, texH);
@@ -33,7 +35,7 @@ bool Item::Start() {
 	pbody->ctype = ColliderType::ITEM;
 
 	// Set this class as the listener of the pbody
-	pbody->listener = this;   // so Begin/EndContact can call back to Item
+	pbody->listener = handle;   // so Begin/EndContact can call back to Item
 
 	return true;
 }
@@ -48,14 +50,35 @@ bool Item::Update(float dt)
 	position.setX((float)x);
 	position.setY((float)y);
 
-	Engine::GetInstance().render->DrawTexture(texture, x - texW / 2, y - texH / 2);
-
 	return true;
 }
 
+bool Item::UpdateAll(Item* const* items, int count, float dt)
+{
+	bool ret = true;
+	for (int i = 0; i < count; ++i) {
+		Item* item = items[i];
+		if (!item->active || item->pendingToDestroy || !item->tickThisFrame) continue;
+		if (!item->Item::Update(item->tickDt)) ret = false;
+	}
+
+	// Only the coins around the camera are drawn. The margin covers the sprite and the movement
+	// since the spatial hash was last updated
+	const std::vector<Entity*>& visible = Engine::GetInstance().entityManager->QueryVisible(64.0f, EntityType::ITEM);
+
+	Render* render = Engine::GetInstance().render.get();
+	for (Entity* entity : visible) {
+		const Item* item = static_cast<const Item*>(entity);
+		if (!item->active || item->pendingToDestroy) continue;
+		render->DrawTexture(item->texture, (int)item->position.getX() - item->texW / 2, (int)item->position.getY() - item->texH / 2);
+	}
+
+	return ret;
+}
+
 bool Item::CleanUp()
 {
-	Engine::GetInstance().textures->UnLoad(texture);
+	Engine::GetInstance().assets->Release(textureAsset);
 	Engine::GetInstance().physics->DeletePhysBody(pbody);
 	return true;
 }
@@ -64,6 +87,6 @@ bool Item::Destroy()
 {
 	LOG("Destroying item");
 	active = false;
-	Engine::GetInstance().entityManager->DestroyEntity(shared_from_this());
+	Engine::GetInstance().entityManager->DestroyEntity(handle);
 	return true;
 }
\ No newline at end of file
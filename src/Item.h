@@ -1,10 +1,9 @@
 #pragma once
 
 #include "Entity.h"
+#include "AssetManager.h"
 #include <SDL3/SDL.h>
 
-struct SDL_Texture;
-
 class Item : public Entity
 {
 public:
@@ -16,8 +15,12 @@ public:
 
 	bool Start();
 
+	// Reads the position from the body, drawing is batched in UpdateAll
 	bool Update(float dt);
 
+	// All the coins in one loop: update the ticking ones, then draw the visible ones
+	static bool UpdateAll(Item* const* items, int count, float dt);
+
 	bool CleanUp();
 
 	bool Destroy();
@@ -25,11 +28,12 @@ public:
 public:
 
 	bool isPicked = false;
+	std::string texturePath = "Assets/Textures/goldCoin.png";
 
 private:
 
-	SDL_Texture* texture;
-	const char* texturePath;
+	TextureAsset textureAsset;
+	TextureHandle texture;
 	int texW, texH;
 
 	//L08 TODO 4: Add a physics to an item
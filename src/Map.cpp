@@ -4,8 +4,15 @@
 #include "Map.h"
 #include "Log.h"
 #include "Physics.h"
+#include "Pathfinding.h"
+#include "XmlStream.h"
+#include "AssetPack.h"
 
 #include <math.h>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
 
 Map::Map() : Module(), mapLoaded(false)
 {
@@ -23,6 +30,16 @@ bool Map::Awake()
     name = "map";
     LOG("Loading Map Parser");
 
+    // Watch the loaded TMX and its tileset images and reload them when they change
+    hotReload = configParameters.child("hotReload").attribute("value").as_bool(false);
+
+    // Packed files win over loose ones, a reload would parse the stale packed copy
+    if (hotReload && Engine::GetInstance().pack->IsOpen())
+    {
+        LOG("Map hot reload disabled: assets are read from the asset pack");
+        hotReload = false;
+    }
+
     return true;
 }
 
@@ -37,11 +54,23 @@ bool Map::Update(float dt)
 
     if (mapLoaded) {
 
+        if (hotReload) UpdateHotReload();
+
+        UpdateTileAnimations(dt);
+
+        // Backdrops go behind every tile layer
+        for (const auto& imageLayer : mapData.imageLayers) {
+            if (imageLayer->visible && imageLayer->image.IsValid()) {
+                Engine::GetInstance().render->DrawStreamedImage(imageLayer->image, (int)imageLayer->offsetX, (int)imageLayer->offsetY,
+                    imageLayer->parallaxX, imageLayer->parallaxY);
+            }
+        }
+
         // L07 TODO 5: Prepare the loop to draw all tiles in a layer + DrawTexture()
         // iterate all tiles in a layer
         for (const auto& mapLayer : mapData.layers) {
             //L09 TODO 7: Check if the property Draw exist get the value, if it's true draw the lawyer
-            if (mapLayer->properties.GetProperty("Draw") != NULL && mapLayer->properties.GetProperty("Draw")->value == true) {
+            if (mapLayer->draw) {
                 for (int i = 0; i < mapData.height; i++) {
                     for (int j = 0; j < mapData.width; j++) {
                         // L07 TODO 9: Complete the draw function
@@ -53,8 +82,9 @@ bool Map::Update(float dt)
                             //L09: TODO 3: Obtain the tile set using GetTilesetFromTileId
                             TileSet* tileSet = GetTilesetFromTileId(gid);
                             if (tileSet != nullptr) {
-                                //Get the Rect from the tileSetTexture;
-                                SDL_Rect tileRect = tileSet->GetRect(gid);
+                                //Get the Rect from the tileSetTexture, animated tiles show their current frame
+                                unsigned int drawnGid = (unsigned int)gid < gidRemap.size() ? gidRemap[gid] : (unsigned int)gid;
+                                SDL_Rect tileRect = tileSet->GetRect(drawnGid);
                                 //Get the screen coordinates from the tile coordinates
                                 Vector2D mapCoord = MapToWorld(i, j);
                                 //Draw the texture
@@ -83,23 +113,78 @@ TileSet* Map::GetTilesetFromTileId(int gid) const
     return set;
 }
 
+void Map::BuildTileAnimations()
+{
+    unsigned int gidCount = 0;
+    for (const auto& tileSet : mapData.tilesets) {
+        if (!tileSet->animations.empty()) gidCount = std::max(gidCount, (unsigned int)(tileSet->firstGid + tileSet->tileCount));
+    }
+
+    // Identity for every gid, only the animated entries change afterwards
+    gidRemap.resize(gidCount);
+    for (unsigned int gid = 0; gid < gidCount; ++gid) gidRemap[gid] = gid;
+
+    for (const auto& tileSet : mapData.tilesets) {
+        tileSet->animationClock = 0.0f;
+        for (auto& animation : tileSet->animations) {
+            animation.currentFrame = 0;
+            gidRemap[tileSet->firstGid + animation.tileId] = tileSet->firstGid + animation.frames[0].tileId;
+        }
+    }
+}
+
+void Map::UpdateTileAnimations(float dt)
+{
+    for (const auto& tileSet : mapData.tilesets) {
+        if (tileSet->animations.empty()) continue;
+
+        // Kept below a day so the float keeps ms precision
+        tileSet->animationClock = fmodf(tileSet->animationClock + dt, 86400000.0f);
+        int clock = (int)tileSet->animationClock;
+
+        for (auto& animation : tileSet->animations) {
+            int time = clock % animation.totalMs;
+            int frame = 0;
+            while (time >= animation.frames[frame].durationMs) {
+                time -= animation.frames[frame].durationMs;
+                frame++;
+            }
+
+            if (frame == animation.currentFrame) continue;
+            animation.currentFrame = frame;
+            gidRemap[tileSet->firstGid + animation.tileId] = tileSet->firstGid + animation.frames[frame].tileId;
+        }
+    }
+}
+
+const Properties* Map::GetTileProperties(int gid) const
+{
+    TileSet* tileSet = GetTilesetFromTileId(gid);
+    return tileSet != nullptr ? tileSet->GetTileProperties(gid) : nullptr;
+}
+
 // Called before quitting
 bool Map::CleanUp()
 {
     LOG("Unloading map");
 
+    if (reloadThread.joinable()) reloadThread.join();
+    reloadData.reset();
+    watcher.Clear();
+
+    DestroyColliders();
+    collisionGrid.Clear();
+
     // L06: TODO 2: Make sure you clean up any memory allocated from tilesets/map
-    for (const auto& tileset : mapData.tilesets) {
-        delete tileset;
+    for (const auto& tileSet : mapData.tilesets) {
+        Engine::GetInstance().textures->Release(tileSet->texture);
     }
-    mapData.tilesets.clear();
-
-    // L07 TODO 2: clean up all layer data
-    for (const auto& layer : mapData.layers)
-    {
-        delete layer;
+    for (const auto& imageLayer : mapData.imageLayers) {
+        Engine::GetInstance().textures->Release(imageLayer->image);
     }
-    mapData.layers.clear();
+    mapData.Clear();
+    gidRemap.clear();
+    mapLoaded = false;
 
     return true;
 }
@@ -114,133 +199,647 @@ bool Map::Load(std::string path, std::string fileName)
     mapPath = path;
     std::string mapPathName = mapPath + mapFileName;
 
-    pugi::xml_document mapFileXML;
-    pugi::xml_parse_result result = mapFileXML.load_file(mapPathName.c_str());
+    std::string error;
+    ret = ParseMapFile(mapPathName, mapData, error);
+    LogWarnings(mapData);
 
-    if (result == NULL)
+    if (ret == false)
     {
-        LOG("Could not load map xml file %s. pugi error: %s", mapPathName.c_str(), result.description());
-        ret = false;
+        LOG("Could not load map xml file %s. %s", mapPathName.c_str(), error.c_str());
     }
     else {
 
-        // L06: TODO 3: Implement LoadMap to load the map properties
-        // retrieve the paremeters of the <map> node and store the into the mapData struct
-        mapData.width = mapFileXML.child("map").attribute("width").as_int();
-        mapData.height = mapFileXML.child("map").attribute("height").as_int();
-        mapData.tileWidth = mapFileXML.child("map").attribute("tilewidth").as_int();
-        mapData.tileHeight = mapFileXML.child("map").attribute("tileheight").as_int();
+        //Load the tileset images
+        LoadTilesetTextures(mapData.tilesets);
+        LoadImageLayers(mapData.imageLayers);
+        BuildTileAnimations();
 
-        // L06: TODO 4: Implement the LoadTileSet function to load the tileset properties
+        // L08 TODO 3: Create colliders
+        // L08 TODO 7: Assign collider type
+        CreateColliders();
+        Engine::GetInstance().pathfinding->BuildGraph(collisionGrid);
 
-        //Iterate the Tileset
-        for (pugi::xml_node tilesetNode = mapFileXML.child("map").child("tileset"); tilesetNode != NULL; tilesetNode = tilesetNode.next_sibling("tileset"))
+        // L06: TODO 5: LOG all the data loaded iterate all tilesetsand LOG everything
+        if (ret == true)
         {
-            //Load Tileset attributes
-            TileSet* tileSet = new TileSet();
-            tileSet->firstGid = tilesetNode.attribute("firstgid").as_int();
-            tileSet->name = tilesetNode.attribute("name").as_string();
-            tileSet->tileWidth = tilesetNode.attribute("tilewidth").as_int();
-            tileSet->tileHeight = tilesetNode.attribute("tileheight").as_int();
-            tileSet->spacing = tilesetNode.attribute("spacing").as_int();
-            tileSet->margin = tilesetNode.attribute("margin").as_int();
-            tileSet->tileCount = tilesetNode.attribute("tilecount").as_int();
-            tileSet->columns = tilesetNode.attribute("columns").as_int();
+            LOG("Successfully parsed map XML file :%s", fileName.c_str());
+            LOG("width : %d height : %d", mapData.width, mapData.height);
+            LOG("tile_width : %d tile_height : %d", mapData.tileWidth, mapData.tileHeight);
+            LOG("Tilesets----");
 
-            //Load the tileset image
-            std::string imgName = tilesetNode.child("image").attribute("source").as_string();
-            tileSet->texture = Engine::GetInstance().textures->Load((mapPath + imgName).c_str());
+            //iterate the tilesets
+            for (const auto& tileset : mapData.tilesets) {
+                LOG("name : %s firstgid : %d", tileset->name.c_str(), tileset->firstGid);
+                LOG("tile width : %d tile height : %d", tileset->tileWidth, tileset->tileHeight);
+                LOG("spacing : %d margin : %d", tileset->spacing, tileset->margin);
+            }
+
+            LOG("Layers----");
 
-            mapData.tilesets.push_back(tileSet);
+            for (const auto& layer : mapData.layers) {
+                LOG("id : %d name : %s", layer->id, layer->name.c_str());
+                LOG("Layer width : %d Layer height : %d", layer->width, layer->height);
+            }
+
+            LOG("Object layers----");
+
+            for (const auto& objectLayer : mapData.objectLayers) {
+                LOG("id : %d name : %s objects : %d", objectLayer->id, objectLayer->name.c_str(), (int)objectLayer->objects.size());
+            }
         }
 
-        // L07: TODO 3: Iterate all layers in the TMX and load each of them
-        for (pugi::xml_node layerNode = mapFileXML.child("map").child("layer"); layerNode != NULL; layerNode = layerNode.next_sibling("layer")) {
+        if (hotReload) WatchMapFiles();
+    }
+
+    mapLoaded = ret;
+    return ret;
+}
+
+// Parse a TMX file into data. Does not touch the map module state nor other modules,
+// so it can run on the hot-reload thread. Tileset textures are left unloaded.
+// The file is streamed front to back and every element goes straight into its final
+// structure, so the peak memory is the map data plus one read chunk and the current tag.
+// A first pass over the tags counts the objects so each object table is allocated once.
+bool Map::ParseMapFile(const std::string& mapPathName, MapData& data, std::string& error)
+{
+    std::vector<int> objectCounts;
+    CountObjects(mapPathName, objectCounts);
+    size_t objectGroup = 0;
+
+    XmlStream xml;
+    if (!xml.Open(mapPathName))
+    {
+        error = xml.GetError();
+        return false;
+    }
+
+    if (xml.Next() != XmlStream::Token::START || !xml.IsNamed("map"))
+    {
+        error = xml.Failed() ? xml.GetError() : "missing map element";
+        return false;
+    }
+
+    std::string path = mapPathName.substr(0, mapPathName.find_last_of("/\\") + 1);
 
-            // L07: TODO 4: Implement the load of a single layer 
-            //Load the attributes and saved in a new MapLayer
+    // L06: TODO 3: Implement LoadMap to load the map properties
+    // retrieve the paremeters of the <map> node and store the into the mapData struct
+    data.width = xml.AttributeInt("width");
+    data.height = xml.AttributeInt("height");
+    data.tileWidth = xml.AttributeInt("tilewidth");
+    data.tileHeight = xml.AttributeInt("tileheight");
+
+    const int mapDepth = xml.Depth();
+    while (xml.NextChild(mapDepth))
+    {
+        // L06: TODO 4: Implement the LoadTileSet function to load the tileset properties
+        if (xml.IsNamed("tileset"))
+        {
+            TileSet* tileSet = new TileSet();
+            data.tilesets.push_back(tileSet);
+            if (!ParseTileSet(xml, path, *tileSet, error)) return false;
+        }
+        // L07: TODO 3: Iterate all layers in the TMX and load each of them
+        else if (xml.IsNamed("layer"))
+        {
             MapLayer* mapLayer = new MapLayer();
-            mapLayer->id = layerNode.attribute("id").as_int();
-            mapLayer->name = layerNode.attribute("name").as_string();
-            mapLayer->width = layerNode.attribute("width").as_int();
-            mapLayer->height = layerNode.attribute("height").as_int();
+            data.layers.push_back(mapLayer);
+            ParseLayer(xml, *mapLayer, data.warnings);
+        }
+        // Load the object layers into flat object tables
+        else if (xml.IsNamed("objectgroup"))
+        {
+            MapObjectLayer* objectLayer = new MapObjectLayer();
+            data.objectLayers.push_back(objectLayer);
+            int objectCount = objectGroup < objectCounts.size() ? objectCounts[objectGroup] : 0;
+            objectGroup++;
+            ParseObjectGroup(xml, *objectLayer, objectCount);
+        }
+        else if (xml.IsNamed("imagelayer"))
+        {
+            MapImageLayer* imageLayer = new MapImageLayer();
+            data.imageLayers.push_back(imageLayer);
+            ParseImageLayer(xml, path, *imageLayer);
+        }
+    }
 
-            //L09: TODO 6 Call Load Layer Properties
-            LoadProperties(layerNode, mapLayer->properties);
+    if (xml.Failed())
+    {
+        error = xml.GetError();
+        return false;
+    }
 
-            //Iterate over all the tiles and assign the values in the data array
-            for (pugi::xml_node tileNode = layerNode.child("data").child("tile"); tileNode != NULL; tileNode = tileNode.next_sibling("tile")) {
-                mapLayer->tiles.push_back(tileNode.attribute("gid").as_int());
-            }
+    return true;
+}
+
+// Objects of each object layer of the TMX, in file order. Only tags are read, the layer
+// data is skipped, and a map that cannot be read leaves counts empty
+void Map::CountObjects(const std::string& mapPathName, std::vector<int>& counts)
+{
+    XmlStream xml;
+    if (!xml.Open(mapPathName) || xml.Next() != XmlStream::Token::START || !xml.IsNamed("map")) return;
+
+    const int mapDepth = xml.Depth();
+    while (xml.NextChild(mapDepth))
+    {
+        if (!xml.IsNamed("objectgroup")) continue;
 
-            //add the layer to the map
-            mapData.layers.push_back(mapLayer);
+        int count = 0;
+        const int groupDepth = xml.Depth();
+        while (xml.NextChild(groupDepth))
+        {
+            if (xml.IsNamed("object")) count++;
         }
+        counts.push_back(count);
+    }
+}
 
-        // L08 TODO 3: Create colliders
-        // L08 TODO 7: Assign collider type
-        // Later you can create a function here to load and create the colliders from the map
+// Tilesets are either embedded in the TMX or stored in an external TSX file
+bool Map::ParseTileSet(XmlStream& xml, const std::string& path, TileSet& tileSet, std::string& error)
+{
+    tileSet.firstGid = xml.AttributeInt("firstgid");
 
-        //Iterate the layer and create colliders
-        for (const auto& mapLayer : mapData.layers) {
-            if (mapLayer->name == "Collisions") {
-                for (int i = 0; i < mapData.height; i++) {
-                    for (int j = 0; j < mapData.width; j++) {
-                        int gid = mapLayer->Get(i, j);
+    const char* source = xml.Attribute("source");
+    if (source == nullptr) return ReadTileSet(xml, path, tileSet, error);
 
-                        // ? CORREGIDO: antes era (gid == 49)
-                        if (gid > 0) {
-                            Vector2D mapCoord = MapToWorld(i, j);
-                            PhysBody* c1 = Engine::GetInstance().physics.get()->CreateRectangle(
-                                mapCoord.getX() + mapData.tileWidth / 2,
-                                mapCoord.getY() + mapData.tileHeight / 2,
-                                mapData.tileWidth,
-                                mapData.tileHeight,
-                                STATIC
-                            );
-                            c1->ctype = ColliderType::PLATFORM;
-                        }
+    tileSet.sourcePath = path + source;
+
+    XmlStream tsx;
+    if (!tsx.Open(tileSet.sourcePath))
+    {
+        error = tsx.GetError();
+        return false;
+    }
+    if (tsx.Next() != XmlStream::Token::START || !tsx.IsNamed("tileset"))
+    {
+        error = tsx.Failed() ? tsx.GetError() : "missing tileset element in " + tileSet.sourcePath;
+        return false;
+    }
+
+    // Image paths in the TSX are relative to the TSX itself
+    return ReadTileSet(tsx, tileSet.sourcePath.substr(0, tileSet.sourcePath.find_last_of("/\\") + 1), tileSet, error);
+}
+
+bool Map::ReadTileSet(XmlStream& xml, const std::string& path, TileSet& tileSet, std::string& error)
+{
+    //Load Tileset attributes
+    tileSet.name = xml.Attribute("name", "");
+    tileSet.tileWidth = xml.AttributeInt("tilewidth");
+    tileSet.tileHeight = xml.AttributeInt("tileheight");
+    tileSet.spacing = xml.AttributeInt("spacing");
+    tileSet.margin = xml.AttributeInt("margin");
+    tileSet.tileCount = xml.AttributeInt("tilecount");
+    tileSet.columns = xml.AttributeInt("columns");
+
+    const int tileSetDepth = xml.Depth();
+    while (xml.NextChild(tileSetDepth))
+    {
+        //Path of the tileset image, loaded by the caller
+        if (xml.IsNamed("image"))
+        {
+            tileSet.imagePath = path + xml.Attribute("source", "");
+        }
+        //Load the custom properties of the tiles
+        else if (xml.IsNamed("tile"))
+        {
+            int id = xml.AttributeInt("id");
+            const int tileDepth = xml.Depth();
+            while (xml.NextChild(tileDepth))
+            {
+                if (xml.IsNamed("properties")) LoadProperties(xml, tileSet.tileProperties[id]);
+                else if (xml.IsNamed("animation"))
+                {
+                    TileAnimation animation;
+                    animation.tileId = id;
+                    const int animationDepth = xml.Depth();
+                    while (xml.NextChild(animationDepth))
+                    {
+                        if (!xml.IsNamed("frame")) continue;
+                        int tileId = xml.AttributeInt("tileid");
+                        int duration = std::max(1, xml.AttributeInt("duration"));
+                        if (tileId < 0 || tileId >= tileSet.tileCount) continue;
+                        animation.frames.push_back({ tileId, duration });
+                        animation.totalMs += duration;
                     }
+                    if (!animation.frames.empty() && id < tileSet.tileCount) tileSet.animations.push_back(animation);
                 }
             }
         }
+    }
 
-        ret = true;
+    if (xml.Failed())
+    {
+        error = xml.GetError();
+        return false;
+    }
+    return true;
+}
 
-        // L06: TODO 5: LOG all the data loaded iterate all tilesetsand LOG everything
-        if (ret == true)
+void Map::ParseLayer(XmlStream& xml, MapLayer& mapLayer, std::vector<std::string>& warnings)
+{
+    static const int drawKey = Properties::Intern("Draw");
+
+    // L07: TODO 4: Implement the load of a single layer 
+    //Load the attributes and saved in a new MapLayer
+    mapLayer.id = xml.AttributeInt("id");
+    mapLayer.name = xml.Attribute("name", "");
+    mapLayer.width = xml.AttributeInt("width");
+    mapLayer.height = xml.AttributeInt("height");
+    mapLayer.tiles.reserve(mapLayer.width * mapLayer.height);
+
+    const int layerDepth = xml.Depth();
+    while (xml.NextChild(layerDepth))
+    {
+        //L09: TODO 6 Call Load Layer Properties
+        if (xml.IsNamed("properties"))
         {
-            LOG("Successfully parsed map XML file :%s", fileName.c_str());
-            LOG("width : %d height : %d", mapData.width, mapData.height);
-            LOG("tile_width : %d tile_height : %d", mapData.tileWidth, mapData.tileHeight);
-            LOG("Tilesets----");
+            LoadProperties(xml, mapLayer.properties);
+        }
+        else if (xml.IsNamed("data"))
+        {
+            //Iterate over all the tiles and assign the values in the data array
+            const char* encoding = xml.Attribute("encoding", "");
+            if (strcmp(encoding, "csv") == 0)
+            {
+                unsigned int gid = 0;
+                while (xml.ReadCsvValue(gid)) mapLayer.tiles.push_back((int)gid);
+            }
+            else if (*encoding == '\0')
+            {
+                const int dataDepth = xml.Depth();
+                while (xml.NextChild(dataDepth))
+                {
+                    if (xml.IsNamed("tile")) mapLayer.tiles.push_back(xml.AttributeInt("gid"));
+                }
+            }
+            else
+            {
+                // Runs on the reload thread too, the caller logs the warning
+                warnings.push_back("Layer " + mapLayer.name + ": " + encoding + " encoding is not supported, save the map as CSV or XML");
+            }
+        }
+    }
 
-            //iterate the tilesets
-            for (const auto& tileset : mapData.tilesets) {
-                LOG("name : %s firstgid : %d", tileset->name.c_str(), tileset->firstGid);
-                LOG("tile width : %d tile height : %d", tileset->tileWidth, tileset->tileHeight);
-                LOG("spacing : %d margin : %d", tileset->spacing, tileset->margin);
+    // Keep Get(i, j) in bounds on truncated or unsupported data
+    mapLayer.tiles.resize(mapLayer.width * mapLayer.height, 0);
+    mapLayer.draw = mapLayer.properties.GetBool(drawKey);
+}
+
+void Map::ParseObjectGroup(XmlStream& xml, MapObjectLayer& objectLayer, int objectCount)
+{
+    static const int drawKey = Properties::Intern("Draw");
+
+    objectLayer.id = xml.AttributeInt("id");
+    objectLayer.name = xml.Attribute("name", "");
+    objectLayer.objects.reserve(objectCount);
+
+    const int groupDepth = xml.Depth();
+    while (xml.NextChild(groupDepth))
+    {
+        if (xml.IsNamed("properties"))
+        {
+            LoadProperties(xml, objectLayer.properties);
+            continue;
+        }
+        if (!xml.IsNamed("object")) continue;
+
+        objectLayer.objects.emplace_back();
+        MapObject& object = objectLayer.objects.back();
+        object.id = xml.AttributeInt("id");
+        object.x = xml.AttributeFloat("x");
+        object.y = xml.AttributeFloat("y");
+        object.width = xml.AttributeFloat("width");
+        object.height = xml.AttributeFloat("height");
+        object.gid = xml.AttributeUInt("gid") & 0x0FFFFFFF; // strip flip flags
+
+        // Tiled 1.9 saved the object type as "class"
+        const char* type = xml.Attribute("type", xml.Attribute("class", ""));
+        if (*type != '\0') object.type = Properties::Intern(type);
+        const char* name = xml.Attribute("name", "");
+        if (*name != '\0') object.name = Properties::Intern(name);
+
+        // Tile objects are anchored at their bottom-left corner
+        if (object.gid != 0) object.y -= object.height;
+
+        const int objectDepth = xml.Depth();
+        while (xml.NextChild(objectDepth))
+        {
+            if (xml.IsNamed("properties")) LoadProperties(xml, object.properties);
+        }
+    }
+
+    objectLayer.draw = objectLayer.properties.GetBool(drawKey);
+}
+
+void Map::ParseImageLayer(XmlStream& xml, const std::string& path, MapImageLayer& imageLayer)
+{
+    imageLayer.id = xml.AttributeInt("id");
+    imageLayer.name = xml.Attribute("name", "");
+    imageLayer.offsetX = xml.AttributeFloat("offsetx");
+    imageLayer.offsetY = xml.AttributeFloat("offsety");
+    imageLayer.parallaxX = xml.AttributeFloat("parallaxx", 1.0f);
+    imageLayer.parallaxY = xml.AttributeFloat("parallaxy", 1.0f);
+    imageLayer.visible = xml.AttributeBool("visible", true);
+
+    const int layerDepth = xml.Depth();
+    while (xml.NextChild(layerDepth))
+    {
+        if (xml.IsNamed("image"))
+        {
+            const char* source = xml.Attribute("source");
+            if (source != nullptr) imageLayer.imagePath = path + source;
+        }
+        else if (xml.IsNamed("properties"))
+        {
+            LoadProperties(xml, imageLayer.properties);
+        }
+    }
+}
+
+// Open the streamed images of the layers that have none yet, tiles are only uploaded once drawn
+void Map::LoadImageLayers(const std::list<MapImageLayer*>& imageLayers)
+{
+    for (const auto& imageLayer : imageLayers) {
+        if (imageLayer->image.IsValid() || imageLayer->imagePath.empty()) continue;
+        imageLayer->image = Engine::GetInstance().textures->AcquireStreamed(imageLayer->imagePath.c_str());
+    }
+}
+
+MapLayer* Map::GetCollisionLayer() const
+{
+    for (const auto& mapLayer : mapData.layers) {
+        if (mapLayer->name == "Collisions") return mapLayer;
+    }
+    return nullptr;
+}
+
+//Iterate the collision layer and create colliders
+void Map::CreateColliders()
+{
+    DestroyColliders();
+    colliders.assign(mapData.width * mapData.height, nullptr);
+    collisionGrid.Init(mapData.width, mapData.height, mapData.tileWidth, mapData.tileHeight);
+
+    MapLayer* collisionLayer = GetCollisionLayer();
+    if (collisionLayer == nullptr) return;
+
+    for (int i = 0; i < mapData.height; i++) {
+        for (int j = 0; j < mapData.width; j++) {
+            // ? CORREGIDO: antes era (gid == 49)
+            if (collisionLayer->Get(i, j) > 0) {
+                CreateCollider(i, j);
+                collisionGrid.Set(i, j, true);
             }
+        }
+    }
+}
 
-            LOG("Layers----");
+void Map::CreateCollider(int i, int j)
+{
+    Vector2D mapCoord = MapToWorld(i, j);
+    PhysBody* c1 = Engine::GetInstance().physics.get()->CreateRectangle(
+        mapCoord.getX() + mapData.tileWidth / 2,
+        mapCoord.getY() + mapData.tileHeight / 2,
+        mapData.tileWidth,
+        mapData.tileHeight,
+        STATIC
+    );
+    c1->ctype = ColliderType::PLATFORM;
+    colliders[(i * mapData.width) + j] = c1;
+}
 
-            for (const auto& layer : mapData.layers) {
-                LOG("id : %d name : %s", layer->id, layer->name.c_str());
-                LOG("Layer width : %d Layer height : %d", layer->width, layer->height);
+void Map::DestroyColliders()
+{
+    for (PhysBody* collider : colliders) {
+        if (collider != nullptr) Engine::GetInstance().physics->DeletePhysBody(collider);
+    }
+    colliders.clear();
+}
+
+// ---------- Hot reload ----------
+
+void Map::WatchMapFiles()
+{
+    watcher.Clear();
+    watcher.Watch(mapPath + mapFileName);
+    for (const auto& tileSet : mapData.tilesets) {
+        watcher.Watch(tileSet->imagePath);
+        if (!tileSet->sourcePath.empty()) watcher.Watch(tileSet->sourcePath);
+    }
+}
+
+void Map::UpdateHotReload()
+{
+    std::vector<std::string> changed;
+    if (watcher.Poll(changed)) {
+        for (const auto& file : changed) {
+            bool tileSetSource = false;
+            for (const auto& tileSet : mapData.tilesets) {
+                if (tileSet->sourcePath == file) tileSetSource = true;
+            }
+            if (file == mapPath + mapFileName || tileSetSource) {
+                // Coalesce edits that arrive while a reload is still parsing
+                if (reloadThread.joinable()) reloadQueued = true;
+                else StartReload();
+                continue;
+            }
+            for (const auto& tileSet : mapData.tilesets) {
+                if (tileSet->imagePath == file) ReloadTilesetTexture(tileSet);
             }
         }
-        else {
-            LOG("Error while parsing map file: %s", mapPathName.c_str());
+    }
+
+    if (reloadDone.load()) {
+        reloadThread.join();
+        reloadDone = false;
+
+        LogWarnings(*reloadData);
+        if (reloadOk) ApplyReload(*reloadData);
+        else LOG("Map hot reload failed: %s", reloadError.c_str());
+        reloadData.reset();
+
+        if (reloadQueued) {
+            reloadQueued = false;
+            StartReload();
         }
+    }
+}
+
+void Map::LogWarnings(MapData& data)
+{
+    for (const auto& warning : data.warnings) {
+        LOG("%s", warning.c_str());
+    }
+    data.warnings.clear();
+}
+
+void Map::StartReload()
+{
+    LOG("Map changed on disk, reloading %s", mapFileName.c_str());
+    reloadData.reset(new MapData());
+    reloadError.clear();
+    reloadOk = false;
+
+    std::string mapPathName = mapPath + mapFileName;
+    reloadThread = std::thread([this, mapPathName]() {
+        reloadOk = ParseMapFile(mapPathName, *reloadData, reloadError);
+        reloadDone = true;
+    });
+}
+
+void Map::ReloadTilesetTexture(TileSet* tileSet)
+{
+    LOG("Reloading tileset image %s", tileSet->imagePath.c_str());
+    Engine::GetInstance().textures->Reload(tileSet->texture);
+}
 
-        if (mapFileXML) mapFileXML.reset();
+// Load the images of the tilesets that have no texture yet in one parallel batch
+int Map::LoadTilesetTextures(const std::list<TileSet*>& tilesets)
+{
+    std::vector<std::string> paths;
+    std::vector<TileSet*> pending;
+    for (const auto& tileSet : tilesets) {
+        if (tileSet->texture.IsValid()) continue;
+        paths.push_back(tileSet->imagePath);
+        pending.push_back(tileSet);
+    }
 
+    std::vector<TextureHandle> loaded;
+    int ret = Engine::GetInstance().textures->LoadBatch(paths, loaded);
+    for (size_t i = 0; i < pending.size(); ++i) {
+        pending[i]->texture = loaded[i];
     }
 
-    mapLoaded = ret;
     return ret;
 }
 
+// Merge a freshly parsed map into the loaded one touching only what changed,
+// so physics bodies of untouched cells and every entity keep their state
+void Map::ApplyReload(MapData& fresh)
+{
+    PerfTimer timer;
+    bool sizeChanged = fresh.width != mapData.width || fresh.height != mapData.height
+        || fresh.tileWidth != mapData.tileWidth || fresh.tileHeight != mapData.tileHeight;
+
+    mapData.width = fresh.width;
+    mapData.height = fresh.height;
+    mapData.tileWidth = fresh.tileWidth;
+    mapData.tileHeight = fresh.tileHeight;
+
+    // Tilesets: keep the texture of every image that is still used
+    int texturesLoaded = 0;
+    for (const auto& tileSet : fresh.tilesets) {
+        for (auto it = mapData.tilesets.begin(); it != mapData.tilesets.end(); ++it) {
+            if ((*it)->imagePath == tileSet->imagePath) {
+                tileSet->texture = (*it)->texture;
+                delete *it;
+                mapData.tilesets.erase(it);
+                break;
+            }
+        }
+    }
+    texturesLoaded = LoadTilesetTextures(fresh.tilesets);
+    for (const auto& tileSet : mapData.tilesets) {
+        Engine::GetInstance().textures->Release(tileSet->texture);
+        delete tileSet;
+    }
+    mapData.tilesets.clear();
+    mapData.tilesets.swap(fresh.tilesets);
+    BuildTileAnimations();
+
+    // Tile layers: patch the cells that differ, matching layers by id
+    MapLayer* oldCollisionLayer = GetCollisionLayer();
+    std::vector<int> changedCollisionCells;
+    bool collisionLayerReplaced = false;
+    int tilesChanged = 0;
+
+    std::list<MapLayer*> layers;
+    for (auto& freshLayer : fresh.layers) {
+        MapLayer* current = nullptr;
+        for (auto it = mapData.layers.begin(); it != mapData.layers.end(); ++it) {
+            if ((*it)->id == freshLayer->id) {
+                current = *it;
+                mapData.layers.erase(it);
+                break;
+            }
+        }
+
+        if (current == nullptr || current->tiles.size() != freshLayer->tiles.size()) {
+            if (current == oldCollisionLayer || freshLayer->name == "Collisions") collisionLayerReplaced = true;
+            delete current;
+            layers.push_back(freshLayer);
+            freshLayer = nullptr;
+            continue;
+        }
+
+        bool isCollisionLayer = current->name == "Collisions";
+        if (isCollisionLayer != (freshLayer->name == "Collisions")) collisionLayerReplaced = true;
+
+        for (size_t index = 0; index < current->tiles.size(); ++index) {
+            if (current->tiles[index] == freshLayer->tiles[index]) continue;
+            current->tiles[index] = freshLayer->tiles[index];
+            tilesChanged++;
+            if (isCollisionLayer) changedCollisionCells.push_back((int)index);
+        }
+
+        current->name = freshLayer->name;
+        current->width = freshLayer->width;
+        current->height = freshLayer->height;
+        current->properties = freshLayer->properties;
+        current->draw = freshLayer->draw;
+        layers.push_back(current);
+    }
+    for (const auto& removed : mapData.layers) {
+        if (removed == oldCollisionLayer) collisionLayerReplaced = true;
+        delete removed;
+    }
+    mapData.layers.clear();
+    mapData.layers.swap(layers);
+
+    // Colliders: rebuild only the changed cells unless the grid itself changed
+    if (sizeChanged || collisionLayerReplaced) {
+        CreateColliders();
+    }
+    else {
+        MapLayer* collisionLayer = GetCollisionLayer();
+        for (int index : changedCollisionCells) {
+            if (colliders[index] != nullptr) {
+                Engine::GetInstance().physics->DeletePhysBody(colliders[index]);
+                colliders[index] = nullptr;
+            }
+            bool solid = collisionLayer->tiles[index] > 0;
+            if (solid) CreateCollider(index / mapData.width, index % mapData.width);
+            collisionGrid.Set(index / mapData.width, index % mapData.width, solid);
+        }
+    }
+    if (sizeChanged || collisionLayerReplaced || !changedCollisionCells.empty()) {
+        Engine::GetInstance().pathfinding->BuildGraph(collisionGrid);
+    }
+
+    // Object tables are replaced, entities already spawned from them keep their state
+    mapData.objectLayers.swap(fresh.objectLayers);
+
+    // Image layers: keep the streamed image of every path still used
+    for (const auto& imageLayer : fresh.imageLayers) {
+        for (const auto& current : mapData.imageLayers) {
+            if (current->image.IsValid() && current->imagePath == imageLayer->imagePath) {
+                imageLayer->image = current->image;
+                current->image = StreamedImageHandle();
+                break;
+            }
+        }
+    }
+    LoadImageLayers(fresh.imageLayers);
+    for (const auto& imageLayer : mapData.imageLayers) {
+        Engine::GetInstance().textures->Release(imageLayer->image);
+    }
+    mapData.imageLayers.swap(fresh.imageLayers);
+
+    WatchMapFiles();
+
+    LOG("Map reloaded in %.2f ms: %d tiles changed, %d collision cells rebuilt, %d tileset images loaded",
+        timer.ReadMs(), tilesChanged, (sizeChanged || collisionLayerReplaced) ? -1 : (int)changedCollisionCells.size(), texturesLoaded);
+}
+
 // L07: TODO 8: Create a method that translates x,y coordinates from map positions to world positions
 Vector2D Map::MapToWorld(int i, int j) const
 {
@@ -253,22 +852,127 @@ Vector2D Map::MapToWorld(int i, int j) const
 }
 
 // L09: TODO 6: Load a group of properties from a node and fill a list with it
-bool Map::LoadProperties(pugi::xml_node& node, Properties& properties)
+// Called with the stream on a <properties> start tag
+bool Map::LoadProperties(XmlStream& xml, Properties& properties)
 {
     bool ret = false;
 
-    for (pugi::xml_node propertieNode = node.child("properties").child("property"); propertieNode; propertieNode = propertieNode.next_sibling("property"))
+    const int propertiesDepth = xml.Depth();
+    while (xml.NextChild(propertiesDepth))
     {
-        Properties::Property* p = new Properties::Property();
-        p->name = propertieNode.attribute("name").as_string();
-        p->value = propertieNode.attribute("value").as_bool(); // (!!) I'm assuming that all values are bool !!
+        if (!xml.IsNamed("property")) continue;
 
-        properties.propertyList.push_back(p);
+        Properties::Property p;
+        p.key = Properties::Intern(xml.Attribute("name", ""));
+
+        // Tiled omits the type attribute for string properties
+        std::string type = xml.Attribute("type", "string");
+        const char* value = xml.Attribute("value");
+
+        if (type == "bool") {
+            p.type = PropertyType::BOOL;
+            p.boolValue = xml.AttributeBool("value");
+        }
+        else if (type == "int" || type == "object") {
+            p.type = PropertyType::INT;
+            p.intValue = xml.AttributeInt("value");
+        }
+        else if (type == "float") {
+            p.type = PropertyType::FLOAT;
+            p.floatValue = xml.AttributeFloat("value");
+        }
+        else if (type == "color") {
+            p.type = PropertyType::COLOR;
+            p.colorValue = ParseColor(value);
+        }
+        else {
+            // string and file properties; multi-line strings are stored as the node text
+            p.type = PropertyType::STRING;
+            if (value != nullptr) p.stringValue = value;
+            else xml.ReadText(p.stringValue);
+        }
+
+        properties.Set(p);
+        ret = true;
     }
 
     return ret;
 }
 
+// Tiled writes colors as #AARRGGBB or #RRGGBB
+SDL_Color Map::ParseColor(const char* text)
+{
+    SDL_Color color = { 0, 0, 0, 255 };
+    if (text == nullptr || *text == '\0') return color;
+    if (*text == '#') text++;
+
+    unsigned int value = (unsigned int)strtoul(text, nullptr, 16);
+    if (strlen(text) > 6) {
+        color.a = (Uint8)((value >> 24) & 0xFF);
+    }
+    color.r = (Uint8)((value >> 16) & 0xFF);
+    color.g = (Uint8)((value >> 8) & 0xFF);
+    color.b = (Uint8)(value & 0xFF);
+
+    return color;
+}
+
+// Property names are interned once so lookups compare ints instead of strings
+static std::unordered_map<std::string, int>& PropertyKeys()
+{
+    static std::unordered_map<std::string, int> keys;
+    return keys;
+}
+
+// Deque so that references returned by KeyName stay valid while new names are added
+static std::deque<std::string>& PropertyNames()
+{
+    static std::deque<std::string> names;
+    return names;
+}
+
+// Maps can be parsed on the hot-reload thread
+static std::mutex& PropertyKeysMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+int Properties::Intern(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(PropertyKeysMutex());
+    auto it = PropertyKeys().find(name);
+    if (it != PropertyKeys().end()) return it->second;
+
+    int key = (int)PropertyNames().size();
+    PropertyNames().push_back(name);
+    PropertyKeys().emplace(name, key);
+    return key;
+}
+
+int Properties::FindKey(const char* name)
+{
+    std::lock_guard<std::mutex> lock(PropertyKeysMutex());
+    auto it = PropertyKeys().find(name);
+    return it != PropertyKeys().end() ? it->second : -1;
+}
+
+const std::string& Properties::KeyName(int key)
+{
+    static const std::string empty;
+    std::lock_guard<std::mutex> lock(PropertyKeysMutex());
+    if (key < 0 || key >= (int)PropertyNames().size()) return empty;
+    return PropertyNames()[key];
+}
+
+void Properties::Set(const Property& property)
+{
+    auto it = std::lower_bound(propertyList.begin(), propertyList.end(), property.key,
+        [](const Property& p, int k) { return p.key < k; });
+    if (it != propertyList.end() && it->key == property.key) *it = property;
+    else propertyList.insert(it, property);
+}
+
 // L10: TODO 7: Create a method to get the map size in pixels
 Vector2D Map::GetMapSizeInPixels()
 {
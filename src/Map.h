@@ -1,44 +1,116 @@
 #pragma once
 
 #include "Module.h"
+#include "FileWatcher.h"
+#include "CollisionGrid.h"
+#include "Textures.h"
 #include <list>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 // L09: TODO 5: Add attributes to the property structure
+enum class PropertyType
+{
+    BOOL,
+    INT,
+    FLOAT,
+    STRING,
+    COLOR
+};
+
 struct Properties
 {
     struct Property
     {
-        std::string name;
-        bool value; //We assume that we are going to work only with bool for the moment
+        int key = -1; // interned name, see Properties::Intern
+        PropertyType type = PropertyType::BOOL;
+        union
+        {
+            bool boolValue;
+            int intValue;
+            float floatValue;
+            SDL_Color colorValue;
+        };
+        std::string stringValue;
+
+        Property() : intValue(0) {}
     };
 
-    std::list<Property*> propertyList;
+    // Flat list kept sorted by key, parsed once at load
+    std::vector<Property> propertyList;
+
+    // Returns the id of a property name, registering it the first time it is seen
+    static int Intern(const std::string& name);
+    // Returns the id of a property name or -1 if no property was ever loaded with it
+    static int FindKey(const char* name);
+    static const std::string& KeyName(int key);
+
+    // Adds or replaces a property keeping the list sorted
+    void Set(const Property& property);
 
-    ~Properties()
+    // L09: DONE 7: Method to ask for the value of a custom property
+    const Property* GetProperty(int key) const
     {
-        for (const auto& property : propertyList)
-        {
-            delete property;
-        }
+        auto it = std::lower_bound(propertyList.begin(), propertyList.end(), key,
+            [](const Property& p, int k) { return p.key < k; });
+        if (it != propertyList.end() && it->key == key) return &(*it);
+        return nullptr;
+    }
 
-        propertyList.clear();
+    const Property* GetProperty(const char* name) const
+    {
+        int key = FindKey(name);
+        return key < 0 ? nullptr : GetProperty(key);
     }
 
-    // L09: DONE 7: Method to ask for the value of a custom property
-    Property* GetProperty(const char* name)
+    bool GetBool(int key, bool defaultValue = false) const
     {
-        for (const auto& property : propertyList) {
-            if (property->name == name) {
-                return property;
-            }
-        }
+        const Property* p = GetProperty(key);
+        return (p != nullptr && p->type == PropertyType::BOOL) ? p->boolValue : defaultValue;
+    }
 
-        return nullptr;
+    int GetInt(int key, int defaultValue = 0) const
+    {
+        const Property* p = GetProperty(key);
+        if (p == nullptr) return defaultValue;
+        if (p->type == PropertyType::INT) return p->intValue;
+        if (p->type == PropertyType::FLOAT) return (int)p->floatValue;
+        return defaultValue;
     }
 
+    float GetFloat(int key, float defaultValue = 0.0f) const
+    {
+        const Property* p = GetProperty(key);
+        if (p == nullptr) return defaultValue;
+        if (p->type == PropertyType::FLOAT) return p->floatValue;
+        if (p->type == PropertyType::INT) return (float)p->intValue;
+        return defaultValue;
+    }
+
+    const std::string& GetString(int key) const
+    {
+        static const std::string empty;
+        const Property* p = GetProperty(key);
+        return (p != nullptr && p->type == PropertyType::STRING) ? p->stringValue : empty;
+    }
+
+    SDL_Color GetColor(int key, SDL_Color defaultValue = { 0, 0, 0, 0 }) const
+    {
+        const Property* p = GetProperty(key);
+        return (p != nullptr && p->type == PropertyType::COLOR) ? p->colorValue : defaultValue;
+    }
+
+    bool Empty() const { return propertyList.empty(); }
+
 };
 
+class PhysBody;
+class XmlStream;
+
 struct MapLayer
 {
     // L07: TODO 1: Add the info to the MapLayer Struct
@@ -48,6 +120,8 @@ struct MapLayer
     int height;
     std::vector<int> tiles;
     Properties properties;
+    // Resolved from the "Draw" property at load so Update does not query it per frame
+    bool draw = false;
 
     // L07: TODO 6: Short function to get the gid value of i,j
     unsigned int Get(int i, int j) const
@@ -56,6 +130,61 @@ struct MapLayer
     }
 };
 
+// Object placed in a Tiled object layer. Type and name are interned like property keys
+struct MapObject
+{
+    int id = 0;
+    int type = -1;
+    int name = -1;
+    float x = 0.0f;
+    float y = 0.0f;
+    float width = 0.0f;
+    float height = 0.0f;
+    unsigned int gid = 0; // tile objects only
+    Properties properties;
+};
+
+struct MapObjectLayer
+{
+    int id;
+    std::string name;
+    Properties properties;
+    bool draw = false;
+    // Sized from a count of the objects before the layer is parsed
+    std::vector<MapObject> objects;
+};
+
+// Tiled image layer, such as a painted backdrop. The image is streamed by tiles so it can be any size
+struct MapImageLayer
+{
+    int id = 0;
+    std::string name;
+    std::string imagePath;
+    float offsetX = 0.0f;
+    float offsetY = 0.0f;
+    // Camera scroll factors, 1 moves with the map and 0 stays fixed on screen
+    float parallaxX = 1.0f;
+    float parallaxY = 1.0f;
+    bool visible = true;
+    Properties properties;
+    StreamedImageHandle image;
+};
+
+// Tiled <animation> of a tile: the frames are other tiles of the same tileset
+struct TileAnimation
+{
+    struct Frame
+    {
+        int tileId;
+        int durationMs;
+    };
+
+    int tileId = 0;
+    std::vector<Frame> frames;
+    int totalMs = 0;
+    int currentFrame = 0;
+};
+
 // L06: TODO 2: Create a struct to hold information for a TileSet
 // Ignore Terrain Types and Tile Types for now, but we want the image!
 
@@ -69,7 +198,22 @@ struct TileSet
     int margin;
     int tileCount;
     int columns;
-    SDL_Texture* texture;
+    std::string imagePath;
+    std::string sourcePath; // external TSX file, empty when embedded in the map
+    TextureHandle texture;
+
+    // Custom properties of individual tiles, keyed by local tile id
+    std::unordered_map<int, Properties> tileProperties;
+
+    // Animated tiles all share the clock of their tileset, in ms
+    std::vector<TileAnimation> animations;
+    float animationClock = 0.0f;
+
+    const Properties* GetTileProperties(unsigned int gid) const
+    {
+        auto it = tileProperties.find((int)gid - firstGid);
+        return it != tileProperties.end() ? &it->second : nullptr;
+    }
 
     // L07: TODO 7: Implement the method that receives the gid and returns a Rect
     SDL_Rect GetRect(unsigned int gid) {
@@ -97,6 +241,49 @@ struct MapData
 
     // L07: TODO 2: Add the info to the MapLayer Struct
     std::list<MapLayer*> layers;
+
+    std::list<MapObjectLayer*> objectLayers;
+
+    std::list<MapImageLayer*> imageLayers;
+
+    // Problems found while parsing, logged by the map module on the main thread
+    std::vector<std::string> warnings;
+
+    MapData() {}
+    MapData(const MapData&) = delete;
+    MapData& operator=(const MapData&) = delete;
+
+    ~MapData()
+    {
+        Clear();
+    }
+
+    // Frees tilesets and layers. Tileset textures and streamed images are released by the map module
+    void Clear()
+    {
+        for (const auto& tileset : tilesets) {
+            delete tileset;
+        }
+        tilesets.clear();
+
+        // L07 TODO 2: clean up all layer data
+        for (const auto& layer : layers) {
+            delete layer;
+        }
+        layers.clear();
+
+        for (const auto& objectLayer : objectLayers) {
+            delete objectLayer;
+        }
+        objectLayers.clear();
+
+        for (const auto& imageLayer : imageLayers) {
+            delete imageLayer;
+        }
+        imageLayers.clear();
+
+        warnings.clear();
+    }
 };
 
 class Map : public Module
@@ -123,18 +310,67 @@ public:
     // Load new map
     bool Load(std::string path, std::string mapFileName);
 
+    // Parse a TMX file without loading textures nor creating colliders
+    bool ParseMapFile(const std::string& mapPathName, MapData& data, std::string& error);
+
     // L07: TODO 8: Create a method that translates x,y coordinates from map positions to world positions
     Vector2D MapToWorld(int i, int j) const;
 
     // L09: TODO 2: Implement function to the Tileset based on a tile id
     TileSet* GetTilesetFromTileId(int gid) const;
 
+    // Properties set on a tile in its tileset, nullptr if it has none
+    const Properties* GetTileProperties(int gid) const;
+
     // L09: TODO 6: Load a group of properties 
-    bool LoadProperties(pugi::xml_node& node, Properties& properties);
+    bool LoadProperties(XmlStream& xml, Properties& properties);
+    static SDL_Color ParseColor(const char* text);
 
 	// L10: TODO 7: Create a method to get the map size in pixels
 	Vector2D GetMapSizeInPixels();
 
+    const std::list<MapObjectLayer*>& GetObjectLayers() const
+    {
+        return mapData.objectLayers;
+    }
+
+    MapLayer* GetCollisionLayer() const;
+
+    // Solidity of the "Collisions" layer, answers cell, rect and ray queries without Box2D
+    const CollisionGrid& GetCollisionGrid() const
+    {
+        return collisionGrid;
+    }
+
+private:
+
+    // Animated tiles: the clocks advance once per frame and rewrite the gid remap the draw loop reads
+    void BuildTileAnimations();
+    void UpdateTileAnimations(float dt);
+
+    // Colliders of the "Collisions" layer, one per solid cell
+    void CreateColliders();
+    void CreateCollider(int i, int j);
+    void DestroyColliders();
+
+    // Streaming TMX parsing, each called with the stream on the element start tag
+    bool ParseTileSet(XmlStream& xml, const std::string& path, TileSet& tileSet, std::string& error);
+    bool ReadTileSet(XmlStream& xml, const std::string& path, TileSet& tileSet, std::string& error);
+    void ParseLayer(XmlStream& xml, MapLayer& mapLayer, std::vector<std::string>& warnings);
+    static void CountObjects(const std::string& mapPathName, std::vector<int>& counts);
+    void ParseObjectGroup(XmlStream& xml, MapObjectLayer& objectLayer, int objectCount);
+    void ParseImageLayer(XmlStream& xml, const std::string& path, MapImageLayer& imageLayer);
+    void LoadImageLayers(const std::list<MapImageLayer*>& imageLayers);
+
+    // Hot reload of the TMX and tileset images
+    void WatchMapFiles();
+    void UpdateHotReload();
+    void StartReload();
+    void LogWarnings(MapData& data);
+    void ReloadTilesetTexture(TileSet* tileSet);
+    int LoadTilesetTextures(const std::list<TileSet*>& tilesets);
+    void ApplyReload(MapData& fresh);
+
 public: 
     std::string mapFileName;
     std::string mapPath;
@@ -143,4 +379,20 @@ private:
     bool mapLoaded;
     // L06: DONE 1: Declare a variable data of the struct MapData
     MapData mapData;
+
+    // Collider of each cell of the collision layer, nullptr for empty cells
+    std::vector<PhysBody*> colliders;
+    CollisionGrid collisionGrid;
+
+    // Gid drawn for each gid, the current frame for animated tiles and the gid itself otherwise
+    std::vector<unsigned int> gidRemap;
+
+    bool hotReload = false;
+    FileWatcher watcher;
+    std::thread reloadThread;
+    std::atomic<bool> reloadDone{ false };
+    bool reloadQueued = false;
+    bool reloadOk = false;
+    std::string reloadError;
+    std::unique_ptr<MapData> reloadData;
 };
\ No newline at end of file
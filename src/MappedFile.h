@@ -0,0 +1,37 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <string>
+
+// Read-only view of a whole file mapped into memory.
+// Uses mmap on POSIX systems and a file mapping on Windows; pages are read on first access.
+class MappedFile
+{
+public:
+
+	MappedFile();
+
+	// Destructor
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Map the file, returns false if it is missing or empty
+	bool Open(const std::string& path);
+	void Close();
+
+	bool IsOpen() const { return data != nullptr; }
+	const Uint8* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+
+	const Uint8* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
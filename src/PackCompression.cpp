@@ -0,0 +1,127 @@
+#include "PackCompression.h"
+
+#include <cstring>
+
+#define LZ_HASH_BITS 16
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+// The block ends with literals: no match starts in the last 12 bytes nor reaches the last 5
+#define LZ_LAST_MATCH_START 12
+#define LZ_LAST_LITERALS 5
+
+static uint32_t Read32(const uint8_t* p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static void WriteLength(std::vector<uint8_t>& out, size_t length)
+{
+	while (length >= 255) {
+		out.push_back(255);
+		length -= 255;
+	}
+	out.push_back((uint8_t)length);
+}
+
+static void WriteSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+	size_t matchCode = matchLength - LZ_MIN_MATCH;
+	uint8_t token = (uint8_t)((literalCount < 15 ? literalCount : 15) << 4);
+	if (matchLength > 0) token |= (uint8_t)(matchCode < 15 ? matchCode : 15);
+	out.push_back(token);
+
+	if (literalCount >= 15) WriteLength(out, literalCount - 15);
+	out.insert(out.end(), literals, literals + literalCount);
+
+	// The last sequence only has literals
+	if (matchLength == 0) return;
+
+	out.push_back((uint8_t)(offset & 0xFF));
+	out.push_back((uint8_t)(offset >> 8));
+	if (matchCode >= 15) WriteLength(out, matchCode - 15);
+}
+
+void PackCompress(const uint8_t* source, size_t size, std::vector<uint8_t>& out)
+{
+	out.clear();
+	out.reserve(size + size / 255 + 16);
+
+	size_t anchor = 0;
+	if (size > LZ_LAST_MATCH_START) {
+		std::vector<size_t> table((size_t)1 << LZ_HASH_BITS, SIZE_MAX);
+		size_t searchEnd = size - LZ_LAST_MATCH_START;
+		size_t matchEnd = size - LZ_LAST_LITERALS;
+
+		size_t i = 0;
+		while (i < searchEnd) {
+			uint32_t sequence = Read32(source + i);
+			uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+			size_t candidate = table[hash];
+			table[hash] = i;
+
+			if (candidate == SIZE_MAX || i - candidate > LZ_MAX_OFFSET || Read32(source + candidate) != sequence) {
+				i++;
+				continue;
+			}
+
+			size_t length = LZ_MIN_MATCH;
+			while (i + length < matchEnd && source[candidate + length] == source[i + length]) length++;
+
+			WriteSequence(out, source + anchor, i - anchor, i - candidate, length);
+			i += length;
+			anchor = i;
+		}
+	}
+
+	WriteSequence(out, source + anchor, size - anchor, 0, 0);
+}
+
+static bool ReadLength(const uint8_t*& in, const uint8_t* end, size_t& length)
+{
+	uint8_t byte;
+	do {
+		if (in >= end) return false;
+		byte = *in++;
+		length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+bool PackDecompress(const uint8_t* source, size_t size, uint8_t* destination, size_t rawSize)
+{
+	const uint8_t* in = source;
+	const uint8_t* end = source + size;
+	size_t written = 0;
+
+	while (in < end) {
+		uint8_t token = *in++;
+
+		size_t literalCount = token >> 4;
+		if (literalCount == 15 && !ReadLength(in, end, literalCount)) return false;
+		if (literalCount > (size_t)(end - in) || literalCount > rawSize - written) return false;
+		memcpy(destination + written, in, literalCount);
+		in += literalCount;
+		written += literalCount;
+
+		if (in == end) break;
+
+		if (end - in < 2) return false;
+		size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+		in += 2;
+		if (offset == 0 || offset > written) return false;
+
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !ReadLength(in, end, matchLength)) return false;
+		matchLength += LZ_MIN_MATCH;
+		if (matchLength > rawSize - written) return false;
+
+		// Byte by byte: the match may overlap the bytes it produces
+		const uint8_t* match = destination + written - offset;
+		for (size_t i = 0; i < matchLength; ++i) destination[written + i] = match[i];
+		written += matchLength;
+	}
+
+	return written == rawSize;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// LZ4 block format codec for pack entries. Fast to decode, no dictionary nor frame header:
+// the decompressed size is stored in the pack table.
+
+// Greedy single-pass compression, out is replaced
+void PackCompress(const uint8_t* source, size_t size, std::vector<uint8_t>& out);
+
+// Returns false if the block is malformed or does not decode to exactly rawSize bytes
+bool PackDecompress(const uint8_t* source, size_t size, uint8_t* destination, size_t rawSize);
@@ -0,0 +1,455 @@
+#include "Pathfinding.h"
+#include "CollisionGrid.h"
+#include "PerfTimer.h"
+#include "Log.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Expansions between two reads of the frame budget timer
+#define EXPANSIONS_PER_CHECK 64
+
+Pathfinding::Pathfinding() : Module()
+{
+	name = "pathfinding";
+}
+
+// Destructor
+Pathfinding::~Pathfinding()
+{}
+
+// Called before render is available
+bool Pathfinding::Awake()
+{
+	LOG("Loading Pathfinding");
+
+	budgetMs = configParameters.child("budget").attribute("ms").as_double(budgetMs);
+	maxRequests = configParameters.child("requests").attribute("max").as_int(maxRequests);
+	maxPathLength = configParameters.child("requests").attribute("pathLength").as_int(maxPathLength);
+	jumpHeight = configParameters.child("jump").attribute("height").as_int(jumpHeight);
+	jumpDistance = configParameters.child("jump").attribute("distance").as_int(jumpDistance);
+	maxFall = configParameters.child("fall").attribute("max").as_int(maxFall);
+
+	// Every buffer used by the requests is allocated once here
+	requests.assign(maxRequests, RequestSlot());
+	pathSteps.resize((size_t)maxRequests * maxPathLength);
+	queue.assign(maxRequests, -1);
+	freeSlots.clear();
+	freeSlots.reserve(maxRequests);
+	for (int i = maxRequests - 1; i >= 0; --i) {
+		requests[i].stepOffset = i * maxPathLength;
+		freeSlots.push_back(i);
+	}
+
+	return true;
+}
+
+// Called each loop iteration
+bool Pathfinding::Update(float dt)
+{
+	// Requests made without a graph are still taken, BeginSearch fails them
+	if (currentRequest < 0 && queueCount == 0) return true;
+
+	PerfTimer timer;
+	while (timer.ReadMs() < budgetMs) {
+
+		// The graph was rebuilt under the running search
+		if (currentRequest >= 0 && currentGraphVersion != graphVersion) BeginSearch(currentRequest);
+
+		if (currentRequest < 0) {
+			if (queueCount == 0) break;
+
+			int slot = queue[queueHead];
+			queueHead = (queueHead + 1) % maxRequests;
+			queueCount--;
+
+			requests[slot].queued = false;
+			if (!requests[slot].used || requests[slot].status != PathStatus::PENDING) continue;
+
+			BeginSearch(slot);
+			if (currentRequest < 0) continue; // solved without searching
+		}
+
+		if (StepSearch(EXPANSIONS_PER_CHECK)) currentRequest = -1;
+	}
+
+	return true;
+}
+
+// Called before quitting
+bool Pathfinding::CleanUp()
+{
+	LOG("Freeing pathfinding");
+	ClearGraph();
+	return true;
+}
+
+// ---------- Graph ----------
+
+bool Pathfinding::IsStandable(const CollisionGrid& grid, int i, int j) const
+{
+	return !grid.IsSolid(i, j) && grid.IsSolid(i + 1, j);
+}
+
+void Pathfinding::AddEdge(int to, NavLink link, float cost)
+{
+	edgeTarget.push_back(to);
+	edgeLink.push_back(link);
+	edgeCost.push_back(cost);
+}
+
+void Pathfinding::AddWalkAndFallEdges(const CollisionGrid& grid, int i, int j)
+{
+	for (int dir = -1; dir <= 1; dir += 2) {
+		int nj = j + dir;
+		if (nj < 0 || nj >= gridWidth || grid.IsSolid(i, nj)) continue;
+
+		if (grid.IsSolid(i + 1, nj)) {
+			AddEdge(cellNode[i * gridWidth + nj], NavLink::WALK, 1.0f);
+			continue;
+		}
+
+		// Step off the ledge and drop down the neighbour column until landing
+		for (int k = i + 1; k <= i + maxFall && k < gridHeight; ++k) {
+			if (grid.IsSolid(k + 1, nj)) {
+				AddEdge(cellNode[k * gridWidth + nj], NavLink::FALL, 1.0f + 0.5f * (k - i));
+				break;
+			}
+		}
+	}
+}
+
+// Straight up to an apex row, across it and down onto the target: each part is a word scan of the grid
+bool Pathfinding::JumpArcIsClear(const CollisionGrid& grid, int i, int j, int ti, int tj) const
+{
+	// The apex row is the one above the higher end, the rise itself is at most jumpHeight cells
+	int apex = std::min(i, ti) - 1;
+	if (apex < 0 || i - ti > jumpHeight) return false;
+
+	if (grid.AnySolidInRect(apex, j, i, j)) return false;
+	if (grid.AnySolidInRow(apex, std::min(j, tj), std::max(j, tj))) return false;
+	return !grid.AnySolidInRect(apex, tj, ti, tj);
+}
+
+void Pathfinding::AddJumpEdges(const CollisionGrid& grid, int i, int j)
+{
+	for (int ti = std::max(0, i - jumpHeight); ti <= std::min(gridHeight - 1, i + jumpHeight); ++ti) {
+		for (int tj = std::max(0, j - jumpDistance); tj <= std::min(gridWidth - 1, j + jumpDistance); ++tj) {
+			// Neighbours on the same row are walked
+			if (ti == i && std::abs(tj - j) <= 1) continue;
+
+			int target = cellNode[ti * gridWidth + tj];
+			if (target < 0 || !JumpArcIsClear(grid, i, j, ti, tj)) continue;
+
+			AddEdge(target, NavLink::JUMP, (float)std::max(std::abs(tj - j), std::abs(ti - i)) + 1.0f);
+		}
+	}
+}
+
+void Pathfinding::BuildGraph(const CollisionGrid& grid)
+{
+	PerfTimer timer;
+	ClearGraph();
+
+	gridWidth = grid.GetWidth();
+	gridHeight = grid.GetHeight();
+	tileWidth = grid.GetTileWidth();
+	tileHeight = grid.GetTileHeight();
+
+	cellNode.assign((size_t)gridWidth * gridHeight, -1);
+	for (int i = 0; i < gridHeight; ++i) {
+		for (int j = 0; j < gridWidth; ++j) {
+			if (!IsStandable(grid, i, j)) continue;
+			cellNode[i * gridWidth + j] = (int)nodeCell.size();
+			nodeCell.push_back(i * gridWidth + j);
+		}
+	}
+
+	int nodeCount = (int)nodeCell.size();
+	edgeStart.resize(nodeCount + 1);
+	edgeTarget.reserve(nodeCount * 8);
+	edgeLink.reserve(nodeCount * 8);
+	edgeCost.reserve(nodeCount * 8);
+
+	for (int node = 0; node < nodeCount; ++node) {
+		edgeStart[node] = (int)edgeTarget.size();
+		int i = nodeCell[node] / gridWidth;
+		int j = nodeCell[node] % gridWidth;
+		AddWalkAndFallEdges(grid, i, j);
+		AddJumpEdges(grid, i, j);
+	}
+	edgeStart[nodeCount] = (int)edgeTarget.size();
+
+	// Node pool sized once per graph
+	nodeG.assign(nodeCount, 0.0f);
+	nodeParent.assign(nodeCount, -1);
+	nodeLink.assign(nodeCount, NavLink::START);
+	nodeStamp.assign(nodeCount, 0);
+	nodeHeapIndex.assign(nodeCount, -1);
+	heap.assign(nodeCount, -1);
+	heapSize = 0;
+	searchStamp = 0;
+	graphVersion++;
+
+	LOG("Navigation graph built in %.2f ms: %d nodes, %d links", timer.ReadMs(), nodeCount, (int)edgeTarget.size());
+}
+
+void Pathfinding::ClearGraph()
+{
+	cellNode.clear();
+	nodeCell.clear();
+	edgeStart.clear();
+	edgeTarget.clear();
+	edgeCost.clear();
+	edgeLink.clear();
+	graphVersion++;
+}
+
+int Pathfinding::FindNode(const Vector2D& position) const
+{
+	if (position.getX() < 0.0f || position.getY() < 0.0f) return -1;
+
+	int j = (int)position.getX() / tileWidth;
+	int i = (int)position.getY() / tileHeight;
+	if (j >= gridWidth || i >= gridHeight) return -1;
+
+	// Agents in the air or sunk into the floor snap to the ground of their column
+	for (int k = std::max(0, i - 1); k <= i + maxFall && k < gridHeight; ++k) {
+		int node = cellNode[k * gridWidth + j];
+		if (node >= 0) return node;
+	}
+	return -1;
+}
+
+// Admissible and consistent: no link costs less than its horizontal span or half its vertical one
+float Pathfinding::Heuristic(int node, int goal) const
+{
+	int a = nodeCell[node];
+	int b = nodeCell[goal];
+	float dx = (float)std::abs(a % gridWidth - b % gridWidth);
+	float dy = (float)std::abs(a / gridWidth - b / gridWidth);
+	return std::max(dx, 0.5f * dy);
+}
+
+// ---------- Requests ----------
+
+PathRequest Pathfinding::RequestPath(const Vector2D& from, const Vector2D& to)
+{
+	PathRequest request;
+	if (freeSlots.empty()) {
+		LOG("Pathfinding: no free request slot, raise <requests max> in config");
+		return request;
+	}
+
+	int slot = freeSlots.back();
+	freeSlots.pop_back();
+
+	RequestSlot& r = requests[slot];
+	r.used = true;
+	r.status = PathStatus::PENDING;
+	r.from = from;
+	r.to = to;
+	r.stepCount = 0;
+
+	// A released slot can still sit in the queue, that entry serves the new request
+	if (!r.queued) {
+		queue[(queueHead + queueCount) % maxRequests] = slot;
+		queueCount++;
+		r.queued = true;
+	}
+
+	request.index = slot;
+	request.generation = r.generation;
+	return request;
+}
+
+bool Pathfinding::IsCurrent(PathRequest request) const
+{
+	return request.index >= 0 && request.index < (int)requests.size()
+		&& requests[request.index].used && requests[request.index].generation == request.generation;
+}
+
+PathStatus Pathfinding::GetStatus(PathRequest request) const
+{
+	return IsCurrent(request) ? requests[request.index].status : PathStatus::INVALID;
+}
+
+const PathStep* Pathfinding::GetPath(PathRequest request, int& count) const
+{
+	count = 0;
+	if (!IsCurrent(request) || requests[request.index].status != PathStatus::FOUND) return nullptr;
+
+	const RequestSlot& r = requests[request.index];
+	count = r.stepCount;
+	return &pathSteps[r.stepOffset];
+}
+
+void Pathfinding::ReleasePath(PathRequest request)
+{
+	if (!IsCurrent(request)) return;
+
+	if (currentRequest == request.index) currentRequest = -1;
+
+	RequestSlot& r = requests[request.index];
+	r.used = false;
+	r.status = PathStatus::INVALID;
+	r.generation++;
+	freeSlots.push_back(request.index);
+}
+
+// ---------- Search ----------
+
+void Pathfinding::BeginSearch(int slot)
+{
+	RequestSlot& r = requests[slot];
+	currentRequest = -1;
+	currentGraphVersion = graphVersion;
+
+	if (nodeCell.empty()) {
+		r.status = PathStatus::NOT_FOUND;
+		return;
+	}
+
+	int start = FindNode(r.from);
+	goalNode = FindNode(r.to);
+	if (start < 0 || goalNode < 0) {
+		r.status = PathStatus::NOT_FOUND;
+		return;
+	}
+
+	// A new stamp resets the whole node pool without touching it
+	if (++searchStamp == 0) {
+		std::fill(nodeStamp.begin(), nodeStamp.end(), 0);
+		searchStamp = 1;
+	}
+
+	heapSize = 0;
+	nodeStamp[start] = searchStamp;
+	nodeG[start] = 0.0f;
+	nodeParent[start] = -1;
+	nodeLink[start] = NavLink::START;
+	nodeHeapIndex[start] = -1;
+	HeapPush(start);
+
+	currentRequest = slot;
+}
+
+bool Pathfinding::StepSearch(int maxExpansions)
+{
+	RequestSlot& r = requests[currentRequest];
+
+	for (int expansion = 0; expansion < maxExpansions; ++expansion) {
+		if (heapSize == 0) {
+			r.status = PathStatus::NOT_FOUND;
+			return true;
+		}
+
+		int node = HeapPop();
+		if (node == goalNode) {
+			WritePath(r, node);
+			return true;
+		}
+
+		for (int e = edgeStart[node]; e < edgeStart[node + 1]; ++e) {
+			int target = edgeTarget[e];
+			float g = nodeG[node] + edgeCost[e];
+
+			if (nodeStamp[target] != searchStamp) {
+				nodeStamp[target] = searchStamp;
+				nodeHeapIndex[target] = -1;
+			}
+			else if (nodeHeapIndex[target] == -2 || g >= nodeG[target]) {
+				continue; // closed, or no better than the known route
+			}
+
+			nodeG[target] = g;
+			nodeParent[target] = node;
+			nodeLink[target] = edgeLink[e];
+
+			if (nodeHeapIndex[target] >= 0) HeapUp(nodeHeapIndex[target]);
+			else HeapPush(target);
+		}
+	}
+
+	return false;
+}
+
+void Pathfinding::WritePath(RequestSlot& request, int goal)
+{
+	int length = 0;
+	for (int node = goal; node >= 0; node = nodeParent[node]) length++;
+
+	// Paths longer than the buffer keep their first steps, the agent asks again when it gets there
+	int index = length - 1;
+	for (int node = goal; node >= 0; node = nodeParent[node], --index) {
+		if (index >= maxPathLength) continue;
+		int cell = nodeCell[node];
+		PathStep& step = pathSteps[request.stepOffset + index];
+		step.position = Vector2D((float)((cell % gridWidth) * tileWidth + tileWidth / 2), (float)((cell / gridWidth) * tileHeight + tileHeight / 2));
+		step.link = nodeLink[node];
+	}
+
+	request.stepCount = std::min(length, maxPathLength);
+	request.status = PathStatus::FOUND;
+}
+
+// Binary min-heap on f = g + h over the preallocated heap array
+
+void Pathfinding::HeapPush(int node)
+{
+	heap[heapSize] = node;
+	nodeHeapIndex[node] = heapSize;
+	HeapUp(heapSize++);
+}
+
+int Pathfinding::HeapPop()
+{
+	int top = heap[0];
+	nodeHeapIndex[top] = -2; // closed
+	if (--heapSize > 0) {
+		heap[0] = heap[heapSize];
+		nodeHeapIndex[heap[0]] = 0;
+		HeapDown(0);
+	}
+	return top;
+}
+
+void Pathfinding::HeapUp(int position)
+{
+	int node = heap[position];
+	float f = nodeG[node] + Heuristic(node, goalNode);
+	while (position > 0) {
+		int parent = (position - 1) / 2;
+		int other = heap[parent];
+		if (nodeG[other] + Heuristic(other, goalNode) <= f) break;
+		heap[position] = other;
+		nodeHeapIndex[other] = position;
+		position = parent;
+	}
+	heap[position] = node;
+	nodeHeapIndex[node] = position;
+}
+
+void Pathfinding::HeapDown(int position)
+{
+	int node = heap[position];
+	float f = nodeG[node] + Heuristic(node, goalNode);
+	for (;;) {
+		int child = position * 2 + 1;
+		if (child >= heapSize) break;
+		float childF = nodeG[heap[child]] + Heuristic(heap[child], goalNode);
+		if (child + 1 < heapSize) {
+			float rightF = nodeG[heap[child + 1]] + Heuristic(heap[child + 1], goalNode);
+			if (rightF < childF) {
+				child++;
+				childF = rightF;
+			}
+		}
+		if (f <= childF) break;
+		heap[position] = heap[child];
+		nodeHeapIndex[heap[position]] = position;
+		position = child;
+	}
+	heap[position] = node;
+	nodeHeapIndex[node] = position;
+}
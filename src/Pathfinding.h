@@ -0,0 +1,153 @@
+#pragma once
+
+#include "Module.h"
+#include "Vector2D.h"
+#include <vector>
+#include <cstdint>
+
+class CollisionGrid;
+
+// How an agent moves along a navigation link
+enum class NavLink
+{
+	START,
+	WALK,
+	FALL,
+	JUMP
+};
+
+enum class PathStatus
+{
+	INVALID,
+	PENDING,
+	FOUND,
+	NOT_FOUND
+};
+
+// Reference to a path request, stale once the request is released
+struct PathRequest
+{
+	int index = -1;
+	uint32_t generation = 0;
+};
+
+struct PathStep
+{
+	Vector2D position; // center of the cell
+	NavLink link;      // link used to arrive to this step
+};
+
+// Platformer navigation over the map collision layer.
+// Nodes are the empty cells standing on a solid one; they are linked by walks, falls off ledges and jumps.
+// Requests are queued and solved with A* under a per-frame time budget, without allocating per query.
+class Pathfinding : public Module
+{
+public:
+
+	Pathfinding();
+
+	// Destructor
+	virtual ~Pathfinding();
+
+	// Called before render is available
+	bool Awake();
+
+	// Called each loop iteration
+	bool Update(float dt);
+
+	// Called before quitting
+	bool CleanUp();
+
+	// Build the navigation graph from the collision layer, called by the map on load
+	void BuildGraph(const CollisionGrid& grid);
+	void ClearGraph();
+
+	// Queue a path query between two world positions, the result is ready in a later update
+	PathRequest RequestPath(const Vector2D& from, const Vector2D& to);
+	PathStatus GetStatus(PathRequest request) const;
+	// Steps of a found path from start to goal, nullptr otherwise
+	const PathStep* GetPath(PathRequest request, int& count) const;
+	// Give back the request slot, the handle becomes stale
+	void ReleasePath(PathRequest request);
+
+	int GetNodeCount() const { return (int)nodeCell.size(); }
+
+private:
+
+	struct RequestSlot
+	{
+		uint32_t generation = 1;
+		bool used = false;
+		bool queued = false;
+		PathStatus status = PathStatus::INVALID;
+		Vector2D from;
+		Vector2D to;
+		int stepCount = 0;
+		int stepOffset = 0; // into pathSteps
+	};
+
+	// Graph construction
+	bool IsStandable(const CollisionGrid& grid, int i, int j) const;
+	void AddEdge(int to, NavLink link, float cost);
+	void AddWalkAndFallEdges(const CollisionGrid& grid, int i, int j);
+	void AddJumpEdges(const CollisionGrid& grid, int i, int j);
+	bool JumpArcIsClear(const CollisionGrid& grid, int i, int j, int ti, int tj) const;
+
+	int FindNode(const Vector2D& position) const;
+	float Heuristic(int node, int goal) const;
+
+	// Search, resumable across frames
+	void BeginSearch(int slot);
+	bool StepSearch(int maxExpansions); // true when the current search is finished
+	void WritePath(RequestSlot& request, int goal);
+	void HeapPush(int node);
+	int HeapPop();
+	void HeapUp(int position);
+	void HeapDown(int position);
+
+	bool IsCurrent(PathRequest request) const;
+
+private:
+
+	// Navigation graph in compressed sparse rows
+	int gridWidth = 0;
+	int gridHeight = 0;
+	int tileWidth = 0;
+	int tileHeight = 0;
+	std::vector<int> cellNode;      // cell -> node, -1 if not standable
+	std::vector<int> nodeCell;      // node -> cell
+	std::vector<int> edgeStart;     // node -> first edge, nodeCount + 1 entries
+	std::vector<int> edgeTarget;
+	std::vector<float> edgeCost;
+	std::vector<NavLink> edgeLink;
+	uint32_t graphVersion = 0;
+
+	// Node pool reused by every search, reset lazily with a search stamp
+	std::vector<float> nodeG;
+	std::vector<int> nodeParent;
+	std::vector<NavLink> nodeLink;
+	std::vector<uint32_t> nodeStamp;
+	std::vector<int> nodeHeapIndex; // -1 not queued, -2 closed
+	std::vector<int> heap;
+	int heapSize = 0;
+	int goalNode = -1;
+	uint32_t searchStamp = 0;
+
+	// Requests
+	std::vector<RequestSlot> requests;
+	std::vector<PathStep> pathSteps; // maxPathLength steps per request slot
+	std::vector<int> freeSlots;
+	std::vector<int> queue;          // ring buffer of request slots
+	int queueHead = 0;
+	int queueCount = 0;
+	int currentRequest = -1;
+	uint32_t currentGraphVersion = 0;
+
+	// Parameters, read from config
+	int maxRequests = 64;
+	int maxPathLength = 256;
+	int jumpHeight = 3;   // cells
+	int jumpDistance = 4; // cells
+	int maxFall = 16;     // cells
+	double budgetMs = 1.0;
+};
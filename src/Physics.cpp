@@ -6,6 +6,7 @@
 #include <SDL3/SDL_keycode.h>
 #include "Render.h"
 #include "Player.h"
+#include "EntityManager.h"
 #include "Window.h"
 #include <vector>
 #include <box2d/box2d.h>
@@ -222,6 +223,7 @@ bool Physics::PostUpdate()
     // Process bodies to delete after the world step
     for (PhysBody* physBody : bodiesToDelete) {
         b2DestroyBody(physBody->body);
+        delete physBody;
     }
     bodiesToDelete.clear();
 
@@ -239,6 +241,10 @@ bool Physics::CleanUp()
         world = b2_nullWorldId;
     }
 
+    // Their Box2D bodies went with the world
+    for (PhysBody* physBody : bodiesToDelete) delete physBody;
+    bodiesToDelete.clear();
+
     return true;
 }
 
@@ -254,8 +260,11 @@ void Physics::BeginContact(b2ShapeId shapeA, b2ShapeId shapeB)
     PhysBody* physB = BodyToPhys(bodyB);
     if (!physA || !physB) return;                  // user data cleared
 
-    if (physA->listener && !IsPendingToDelete(physA)) physA->listener->OnCollision(physA, physB);
-    if (physB->listener && !IsPendingToDelete(physB)) physB->listener->OnCollision(physB, physA);
+    // Listeners destroyed since the body was created resolve to nullptr
+    Entity* listenerA = IsPendingToDelete(physA) ? nullptr : Engine::GetInstance().entityManager->GetEntity(physA->listener);
+    if (listenerA) listenerA->OnCollision(physA, physB);
+    Entity* listenerB = IsPendingToDelete(physB) ? nullptr : Engine::GetInstance().entityManager->GetEntity(physB->listener);
+    if (listenerB) listenerB->OnCollision(physB, physA);
 }
 
 void Physics::EndContact(b2ShapeId shapeA, b2ShapeId shapeB)
@@ -271,8 +280,10 @@ void Physics::EndContact(b2ShapeId shapeA, b2ShapeId shapeB)
     if (!physA || !physB) return;
     if (IsPendingToDelete(physA) || IsPendingToDelete(physB)) return;
 
-    if (physA->listener && !IsPendingToDelete(physA)) physA->listener->OnCollisionEnd(physA, physB);
-    if (physB->listener && !IsPendingToDelete(physB)) physB->listener->OnCollisionEnd(physB, physA);
+    Entity* listenerA = Engine::GetInstance().entityManager->GetEntity(physA->listener);
+    if (listenerA) listenerA->OnCollisionEnd(physA, physB);
+    Entity* listenerB = Engine::GetInstance().entityManager->GetEntity(physB->listener);
+    if (listenerB) listenerB->OnCollisionEnd(physB, physA);
 }
 
 
@@ -280,26 +291,22 @@ void Physics::EndContact(b2ShapeId shapeA, b2ShapeId shapeB)
 void Physics::DeletePhysBody(PhysBody* physBody)
 {
 	if (B2_IS_NULL(world)) return; // world already destroyed
-    if (physBody && !B2_IS_NULL(physBody->body) && physBody->listener->active)
+    Entity* listener = physBody ? Engine::GetInstance().entityManager->GetEntity(physBody->listener) : nullptr;
+    if (physBody && !B2_IS_NULL(physBody->body) && (listener == nullptr || listener->active))
     {
         // Dont change contact/sensor flags here (can mismatch event buffers).
         // Just clear user data so late events wont dereference a dangling PhysBody*.
         b2Body_SetUserData(physBody->body, nullptr);
     }
+    if (physBody == nullptr || physBody->pendingToDelete) return;
+    physBody->pendingToDelete = true;
     bodiesToDelete.push_back(physBody);
 }
 
 
 
 bool Physics::IsPendingToDelete(PhysBody* physBody) {
-    bool pendingToDelete = false;
-    for (PhysBody* _physBody : bodiesToDelete) {
-        if (_physBody == physBody) {
-            pendingToDelete = true;
-            break;
-        }
-    }
-    return pendingToDelete;
+    return physBody->pendingToDelete;
 }
 
 // --- Velocity helpers
@@ -1,7 +1,7 @@
 #pragma once
 #include "Module.h"
 #include "Entity.h"
-#include <list>
+#include <vector>
 #include <cmath>           // for floor in METERS_TO_PIXELS
 #include <box2d/box2d.h>   // Box2D 3.x single header
 
@@ -37,7 +37,7 @@ enum class ColliderType {
 class PhysBody
 {
 public:
-    PhysBody() : listener(NULL), body(b2_nullBodyId), ctype(ColliderType::UNKNOWN) {}
+    PhysBody() : body(b2_nullBodyId), ctype(ColliderType::UNKNOWN), pendingToDelete(false) {}
     ~PhysBody() {}
 
     void  GetPosition(int& x, int& y) const;
@@ -48,8 +48,9 @@ public:
 
 public:
     b2BodyId body;              // id instead of pointer (v3.x)
-    Entity* listener;
+    EntityHandle listener;      // entity notified of the collisions, resolved through the entity manager
     ColliderType ctype;
+    bool pendingToDelete;       // set by DeletePhysBody, destroyed in the next PostUpdate
 };
 
 // Module --------------------------------------
@@ -121,6 +122,6 @@ private:
     // Box2D World (id instead of pointer)
     b2WorldId world;
 
-    // List of physics bodies
-    std::list<PhysBody*> bodiesToDelete;
+    // Bodies destroyed together in PostUpdate, after the world step and the entity updates
+    std::vector<PhysBody*> bodiesToDelete;
 };
@@ -2,6 +2,8 @@
 #include "Engine.h"
 #include "Textures.h"
 #include "Audio.h"
+#include "AssetManager.h"
+#include "AnimationSystem.h"
 #include "Input.h"
 #include "Render.h"
 #include "Scene.h"
@@ -10,6 +12,11 @@
 #include "EntityManager.h"
 #include "Map.h"
 
+// Parameters of Assets/Animations/player.xml, hashed at compile time
+static constexpr AnimParamId kMovingParam = MakeParamId("moving");
+static constexpr AnimParamId kGroundedParam = MakeParamId("grounded");
+static constexpr AnimParamId kJumpParam = MakeParamId("jump");
+
 Player::Player() : Entity(EntityType::PLAYER)
 {
 	name = "Player";
@@ -28,17 +35,22 @@ bool Player::Awake() {
 
 bool Player::Start() {
 
-	// load
+	// load, the clips are parsed once and shared through the asset manager, the animation system plays them
+	// and its state machine picks the clip from the parameters set below
 	std::unordered_map<int, std::string> aliases = { {0,"idle"},{11,"move"},{22,"jump"} };
-	anims.LoadFromTSX("Assets/Textures/player1Spritesheet.tsx", aliases);
-	anims.SetCurrent("idle");
-	anims.SetCurrent("move");
-	anims.SetCurrent("jump");
+	animsAsset = Engine::GetInstance().assets->LoadAnimations("Assets/Textures/player1Spritesheet.tsx", aliases);
+	stateMachineAsset = Engine::GetInstance().assets->LoadStateMachine("Assets/Animations/player.xml");
+	animator = Engine::GetInstance().animations->Create(Engine::GetInstance().assets->GetAnimations(animsAsset),
+		Engine::GetInstance().assets->GetStateMachine(stateMachineAsset));
+	movingParam = Engine::GetInstance().animations->FindParameter(animator, kMovingParam);
+	groundedParam = Engine::GetInstance().animations->FindParameter(animator, kGroundedParam);
+	jumpParam = Engine::GetInstance().animations->FindParameter(animator, kJumpParam);
 
 
 
 	//L03: TODO 2: Initialize Player parameters
-	texture = Engine::GetInstance().textures->Load("Assets/Textures/player1_spritesheet.png");
+	textureAsset = Engine::GetInstance().assets->LoadTexture("Assets/Textures/player1_spritesheet.png");
+	texture = Engine::GetInstance().assets->GetTexture(textureAsset);
 
 	// L08 TODO 5: Add physics to the player - initialize physics body
 	//Engine::GetInstance().textures->GetSize(texture, texW, texH);
@@ -46,14 +58,15 @@ bool Player::Start() {
 	texH = 32;
 	pbody = Engine::GetInstance().physics->CreateCircle((int)position.getX(), (int)position.getY(), texW / 2, bodyType::DYNAMIC);
 
-	// L08 TODO 6: Assign player class (using "this") to the listener of the pbody. This makes the Physics module to call the OnCollision method
-	pbody->listener = this;
+	// L08 TODO 6: Assign the player handle to the listener of the pbody. This makes the Physics module to call the OnCollision method
+	pbody->listener = handle;
 
 	// L08 TODO 7: Assign collider type
 	pbody->ctype = ColliderType::PLAYER;
 
 	//initialize audio effect
-	pickCoinFxId = Engine::GetInstance().audio->LoadFx("Assets/Audio/Fx/coin-collision-sound-342335.wav");
+	pickCoinFx = Engine::GetInstance().assets->LoadSound("Assets/Audio/Fx/coin-collision-sound-342335.wav");
+	pickCoinFxId = Engine::GetInstance().assets->GetSound(pickCoinFx);
 
 	return true;
 }
@@ -92,19 +105,19 @@ void Player::Move() {
 	// Move left/right
 	if (Engine::GetInstance().input->GetKey(SDL_SCANCODE_A) == KEY_REPEAT) {
 		velocity.x = -speed;
-		anims.SetCurrent("move");
 	}
 	if (Engine::GetInstance().input->GetKey(SDL_SCANCODE_D) == KEY_REPEAT) {
 		velocity.x = speed;
-		anims.SetCurrent("move");
 	}
+	Engine::GetInstance().animations->SetBool(animator, movingParam, velocity.x != 0.0f);
 }
 
 void Player::Jump() {
 	// This function can be used for more complex jump logic if needed
 	if (Engine::GetInstance().input->GetKey(SDL_SCANCODE_SPACE) == KEY_DOWN && isJumping == false) {
 		Engine::GetInstance().physics->ApplyLinearImpulseToCenter(pbody, 0.0f, -jumpForce, true);
-		anims.SetCurrent("jump");
+		Engine::GetInstance().animations->SetTrigger(animator, jumpParam);
+		Engine::GetInstance().animations->SetBool(animator, groundedParam, false);
 		isJumping = true;
 	}
 }
@@ -121,8 +134,8 @@ void Player::ApplyPhysics() {
 
 void Player::Draw(float dt)
 {
-	anims.Update(dt);
-	const SDL_Rect& animFrame = anims.GetCurrentFrame();
+	// Advanced by the animation system before the entities update
+	const SDL_Rect& animFrame = Engine::GetInstance().animations->GetFrame(animator);
 
 	int x, y;
 	pbody->GetPosition(x, y);
@@ -186,7 +199,11 @@ void Player::Draw(float dt)
 bool Player::CleanUp()
 {
 	LOG("Cleanup player");
-	Engine::GetInstance().textures->UnLoad(texture);
+	Engine::GetInstance().animations->Destroy(animator);
+	Engine::GetInstance().assets->Release(textureAsset);
+	Engine::GetInstance().assets->Release(pickCoinFx);
+	Engine::GetInstance().assets->Release(animsAsset);
+	Engine::GetInstance().assets->Release(stateMachineAsset);
 	return true;
 }
 
@@ -200,12 +217,12 @@ void Player::OnCollision(PhysBody* physA, PhysBody* physB) {
 		LOG("Collision PLATFORM");
 		//reset the jump flag when touching the ground
 		isJumping = false;
-		anims.SetCurrent("idle");
+		Engine::GetInstance().animations->SetBool(animator, groundedParam, true);
 		break;
 	case ColliderType::ITEM:
 		LOG("Collision ITEM");
 		Engine::GetInstance().audio->PlayFx(pickCoinFxId);
-		physB->listener->Destroy();
+		if (Entity* item = Engine::GetInstance().entityManager->GetEntity(physB->listener)) item->Destroy();
 		break;
 	case ColliderType::UNKNOWN:
 		LOG("Collision UNKNOWN");
@@ -1,7 +1,8 @@
 #pragma once
 
 #include "Entity.h"
-#include "Animation.h"
+#include "AnimationSystem.h"
+#include "AssetManager.h"
 #include <box2d/box2d.h>
 #include <SDL3/SDL.h>
 
@@ -44,11 +45,13 @@ public:
 
 	//Declare player parameters
 	float speed = 4.0f;
-	SDL_Texture* texture = NULL;
+	TextureAsset textureAsset;
+	TextureHandle texture;
 
 	int texW = 0, texH = 0;
 
 	//Audio fx
+	SoundAsset pickCoinFx;
 	int pickCoinFxId = 0;
 
 	// L08 TODO 5: Add physics to the player - declare a Physics body
@@ -58,7 +61,13 @@ public:
 
 private:
 	b2Vec2 velocity = { 0.0f, 0.0f };
-	AnimationSet anims;
+	AnimationAsset animsAsset;
+	StateMachineAsset stateMachineAsset;
+	AnimatorHandle animator;
+	// State machine parameter indices resolved once at Start
+	int movingParam = -1;
+	int groundedParam = -1;
+	int jumpParam = -1;
 
 	// --- GOD MODE ---
 	bool godMode = false;
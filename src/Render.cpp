@@ -199,6 +199,55 @@ bool Render::DrawTexture(SDL_Texture* texture, int x, int y, const SDL_Rect* sec
 	return ret;
 }
 
+// Blit a texture of the cache, stale handles draw nothing
+bool Render::DrawTexture(TextureHandle texture, int x, int y, const SDL_Rect* section, float speed, double angle, int pivotX, int pivotY) const
+{
+	SDL_Rect region;
+	SDL_Texture* sdlTexture = Engine::GetInstance().textures->Get(texture, &region);
+	if (sdlTexture == nullptr) return false;
+
+	// Sections are relative to the image, move them to where it sits in its atlas page
+	SDL_Rect atlasSection = section != NULL ? *section : SDL_Rect{ 0, 0, region.w, region.h };
+	atlasSection.x += region.x;
+	atlasSection.y += region.y;
+
+	return DrawTexture(sdlTexture, x, y, &atlasSection, speed, angle, pivotX, pivotY);
+}
+
+bool Render::DrawStreamedImage(StreamedImageHandle image, int x, int y, float speedX, float speedY)
+{
+	int scale = Engine::GetInstance().window->GetScale();
+	int cameraX = (int)(camera.x * speedX);
+	int cameraY = (int)(camera.y * speedY);
+
+	// Part of the image on screen, in image pixels, one pixel wider for the rounding
+	SDL_Rect visible;
+	visible.x = -cameraX / scale - x - 1;
+	visible.y = -cameraY / scale - y - 1;
+	visible.w = camera.w / scale + 2;
+	visible.h = camera.h / scale + 2;
+
+	if (!Engine::GetInstance().textures->StreamTiles(image, visible, streamedTiles)) return false;
+
+	bool ret = true;
+	for (const StreamedTile& tile : streamedTiles)
+	{
+		SDL_FRect rect;
+		rect.x = static_cast<float>(cameraX + (x + tile.rect.x) * scale);
+		rect.y = static_cast<float>(cameraY + (y + tile.rect.y) * scale);
+		rect.w = static_cast<float>(tile.rect.w * scale);
+		rect.h = static_cast<float>(tile.rect.h * scale);
+
+		if (!SDL_RenderTexture(renderer, tile.texture, NULL, &rect))
+		{
+			LOG("Cannot blit to screen. SDL_RenderTexture error: %s", SDL_GetError());
+			ret = false;
+		}
+	}
+
+	return ret;
+}
+
 bool Render::DrawRectangle(const SDL_Rect& rect, Uint8 r, Uint8 g, Uint8 b, Uint8 a, bool filled, bool use_camera) const
 {
 	bool ret = true;
@@ -2,6 +2,7 @@
 
 #include "Module.h"
 #include "Vector2D.h"
+#include "Textures.h"
 #include "SDL3/SDL.h"
 
 class Render : public Module
@@ -32,6 +33,9 @@ public:
 
 	// Drawing
 	bool DrawTexture(SDL_Texture* texture, int x, int y, const SDL_Rect* section = NULL, float speed = 1.0f, double angle = 0, int pivotX = INT_MAX, int pivotY = INT_MAX) const;
+	bool DrawTexture(TextureHandle texture, int x, int y, const SDL_Rect* section = NULL, float speed = 1.0f, double angle = 0, int pivotX = INT_MAX, int pivotY = INT_MAX) const;
+	// Draw a streamed image as one picture, uploading the tiles that come into view. Speeds scroll it like DrawTexture
+	bool DrawStreamedImage(StreamedImageHandle image, int x, int y, float speedX = 1.0f, float speedY = 1.0f);
 	bool DrawRectangle(const SDL_Rect& rect, Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255, bool filled = true, bool useCamera = true) const;
 	bool DrawLine(int x1, int y1, int x2, int y2, Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255, bool useCamera = true) const;
 	bool DrawCircle(int x1, int y1, int radius, Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255, bool useCamera = true) const;
@@ -53,4 +57,5 @@ public:
 
 private:
 	bool vsync = false;
+	std::vector<StreamedTile> streamedTiles; // reused by DrawStreamedImage
 };
@@ -28,11 +28,7 @@ bool Scene::Awake()
 	bool ret = true;
 
 	//L04: TODO 3b: Instantiate the player using the entity manager
-	player = std::dynamic_pointer_cast<Player>(Engine::GetInstance().entityManager->CreateEntity(EntityType::PLAYER));
-	
-	//L08: TODO 4: Create a new item using the entity manager and set the position to (200, 672) to test
-	std::shared_ptr<Item> item = std::dynamic_pointer_cast<Item>(Engine::GetInstance().entityManager->CreateEntity(EntityType::ITEM));
-	item->position = Vector2D(200, 672);
+	player = Engine::GetInstance().entityManager->CreateEntity(EntityType::PLAYER)->handle;
 
 	return ret;
 }
@@ -45,7 +41,10 @@ bool Scene::Start()
 
 	//L06 TODO 3: Call the function to load the map. 
 	Engine::GetInstance().map->Load("Assets/Maps/", "MapaPrueba3.tmx");
-	
+
+	// Items and other placed entities come from the map object layers
+	Engine::GetInstance().entityManager->SpawnFromObjectLayers(Engine::GetInstance().map->GetObjectLayers());
+
 	return true;
 }
 
@@ -32,8 +32,10 @@ public:
 	// Called before quitting
 	bool CleanUp();
 
+	EntityHandle GetPlayer() const { return player; }
+
 private:
 
 	//L03: TODO 3b: Declare a Player attribute
-	std::shared_ptr<Player> player;
+	EntityHandle player;
 };
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "SpatialHash.h"
+#include "Entity.h"
+
+#include <cmath>
+
+void SpatialHash::Init(int size)
+{
+	Clear();
+	cellSize = size > 0 ? size : 128;
+}
+
+void SpatialHash::Clear()
+{
+	for (auto& cell : cells) {
+		for (Entity* entity : cell.second) entity->spatialIndex = -1;
+	}
+	cells.clear();
+	count = 0;
+}
+
+void SpatialHash::Insert(Entity* entity)
+{
+	if (Contains(entity)) return;
+
+	uint64_t key = CellKey(CellCoord(entity->position.getX()), CellCoord(entity->position.getY()));
+	std::vector<Entity*>& cell = cells[key];
+	entity->spatialCell = key;
+	entity->spatialIndex = (int)cell.size();
+	cell.push_back(entity);
+	count++;
+}
+
+void SpatialHash::Remove(Entity* entity)
+{
+	if (!Contains(entity)) return;
+
+	// Move the last entity of the cell into the hole
+	std::vector<Entity*>& cell = cells[entity->spatialCell];
+	Entity* last = cell.back();
+	cell[entity->spatialIndex] = last;
+	last->spatialIndex = entity->spatialIndex;
+	cell.pop_back();
+
+	entity->spatialIndex = -1;
+	count--;
+}
+
+void SpatialHash::Update(Entity* entity)
+{
+	if (!Contains(entity)) {
+		Insert(entity);
+		return;
+	}
+
+	uint64_t key = CellKey(CellCoord(entity->position.getX()), CellCoord(entity->position.getY()));
+	if (key == entity->spatialCell) return;
+
+	Remove(entity);
+	Insert(entity);
+}
+
+bool SpatialHash::Contains(const Entity* entity) const
+{
+	return entity->spatialIndex >= 0;
+}
+
+void SpatialHash::QueryRect(float x, float y, float width, float height, std::vector<Entity*>& result, EntityType type) const
+{
+	if (count == 0 || width < 0.0f || height < 0.0f) return;
+
+	int minX = CellCoord(x);
+	int minY = CellCoord(y);
+	int maxX = CellCoord(x + width);
+	int maxY = CellCoord(y + height);
+
+	auto test = [&](const std::vector<Entity*>& cell) {
+		for (Entity* entity : cell) {
+			if (type != EntityType::UNKNOWN && entity->type != type) continue;
+			float px = entity->position.getX();
+			float py = entity->position.getY();
+			if (px >= x && px <= x + width && py >= y && py <= y + height) result.push_back(entity);
+		}
+	};
+
+	// Areas covering more cells than are occupied walk the occupied ones instead
+	int64_t area = (int64_t)(maxX - minX + 1) * (maxY - minY + 1);
+	if (area > (int64_t)cells.size()) {
+		for (const auto& cell : cells) test(cell.second);
+		return;
+	}
+
+	for (int cellY = minY; cellY <= maxY; ++cellY) {
+		for (int cellX = minX; cellX <= maxX; ++cellX) {
+			auto it = cells.find(CellKey(cellX, cellY));
+			if (it != cells.end()) test(it->second);
+		}
+	}
+}
+
+void SpatialHash::QueryRadius(float x, float y, float radius, std::vector<Entity*>& result, EntityType type) const
+{
+	size_t first = result.size();
+	QueryRect(x - radius, y - radius, radius * 2.0f, radius * 2.0f, result, type);
+
+	// Drop the corners of the square
+	size_t kept = first;
+	for (size_t i = first; i < result.size(); ++i) {
+		float dx = result[i]->position.getX() - x;
+		float dy = result[i]->position.getY() - y;
+		if (dx * dx + dy * dy <= radius * radius) result[kept++] = result[i];
+	}
+	result.resize(kept);
+}
+
+int SpatialHash::CellCoord(float value) const
+{
+	return (int)std::floor(value / cellSize);
+}
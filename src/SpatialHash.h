@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+class Entity;
+enum class EntityType;
+
+// Uniform grid of entities bucketed by their position, for culling and neighbor queries.
+// Only occupied cells are stored, so the world has no bounds. Each entity keeps its own
+// bucket and index, so moving or removing one is O(1).
+class SpatialHash
+{
+public:
+
+	SpatialHash() {}
+
+	void Init(int cellSize);
+	void Clear();
+
+	void Insert(Entity* entity);
+	void Remove(Entity* entity);
+
+	// Re-buckets an entity after its position changed, nothing to do while it stays in its cell
+	void Update(Entity* entity);
+
+	bool Contains(const Entity* entity) const;
+
+	// Entities whose position is inside the area, appended to result.
+	// EntityType::UNKNOWN matches every type
+	void QueryRect(float x, float y, float width, float height, std::vector<Entity*>& result, EntityType type) const;
+	void QueryRadius(float x, float y, float radius, std::vector<Entity*>& result, EntityType type) const;
+
+	int GetCellSize() const { return cellSize; }
+	int GetCount() const { return count; }
+
+private:
+
+	int CellCoord(float value) const;
+	static uint64_t CellKey(int cellX, int cellY)
+	{
+		return ((uint64_t)(uint32_t)cellX << 32) | (uint32_t)cellY;
+	}
+
+private:
+
+	int cellSize = 128;
+	int count = 0;
+
+	// Emptied cells keep their storage, so entities moving around do not allocate
+	std::unordered_map<uint64_t, std::vector<Entity*>> cells;
+};
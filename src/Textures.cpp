@@ -1,8 +1,41 @@
 #include "Engine.h"
 #include "Render.h"
 #include "Textures.h"
+#include "AssetPack.h"
 #include "Log.h"
 
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <cstdio>
+#include <algorithm>
+
+// Layout of a decoded texture cache file, followed by height * pitch bytes of pixels
+struct TextureCacheHeader
+{
+	char magic[4];
+	Uint32 version;
+	Uint64 sourceHash;
+	Uint32 format;
+	Sint32 width;
+	Sint32 height;
+	Sint32 pitch;
+};
+
+static const char TEXTURE_CACHE_MAGIC[4] = { 'T', 'X', 'C', 'H' };
+static const Uint32 TEXTURE_CACHE_VERSION = 1;
+
+// FNV-1a, fast enough to hash every image on startup
+static Uint64 HashBytes(const Uint8* data, size_t size)
+{
+	Uint64 hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
 Textures::Textures() : Module()
 {
 	name = "textures";
@@ -19,6 +52,19 @@ bool Textures::Awake()
 	LOG("Init Image library");
 	bool ret = true;
 
+	decodeThreads = configParameters.child("decodeThreads").attribute("value").as_int(0);
+	cacheEnabled = configParameters.child("cache").attribute("enabled").as_bool(cacheEnabled);
+	cacheDirectory = configParameters.child("cache").attribute("path").as_string(cacheDirectory.c_str());
+	budgetBytes = (size_t)configParameters.child("budget").attribute("mb").as_int(0) * 1024 * 1024;
+	atlasEnabled = configParameters.child("atlas").attribute("enabled").as_bool(atlasEnabled);
+	atlasPageSize = configParameters.child("atlas").attribute("pageSize").as_int(atlasPageSize);
+	atlasMaxImageSize = configParameters.child("atlas").attribute("maxImageSize").as_int(atlasMaxImageSize);
+	streamTileSize = configParameters.child("streaming").attribute("tileSize").as_int(streamTileSize);
+	streamPrefetch = configParameters.child("streaming").attribute("prefetch").as_int(streamPrefetch);
+	streamRelease = configParameters.child("streaming").attribute("release").as_int(streamRelease);
+	streamUploads = configParameters.child("streaming").attribute("uploadsPerFrame").as_int(streamUploads);
+	streamBudgetBytes = (size_t)configParameters.child("streaming").attribute("budgetMb").as_int(0) * 1024 * 1024;
+
 	return ret;
 }
 
@@ -27,83 +73,932 @@ bool Textures::Start()
 {
 	LOG("start textures");
 	bool ret = true;
+
+	// Store pixels in the first 32 bit format the renderer lists, so uploads need no conversion
+	SDL_PropertiesID properties = SDL_GetRendererProperties(Engine::GetInstance().render->renderer);
+	const SDL_PixelFormat* formats = (const SDL_PixelFormat*)SDL_GetPointerProperty(properties, SDL_PROP_RENDERER_TEXTURE_FORMATS_POINTER, NULL);
+	for (; formats != NULL && *formats != SDL_PIXELFORMAT_UNKNOWN; ++formats) {
+		if (*formats == SDL_PIXELFORMAT_ARGB8888 || *formats == SDL_PIXELFORMAT_ABGR8888
+			|| *formats == SDL_PIXELFORMAT_RGBA8888 || *formats == SDL_PIXELFORMAT_BGRA8888) {
+			textureFormat = *formats;
+			break;
+		}
+	}
+
+	int maxTextureSize = (int)SDL_GetNumberProperty(properties, SDL_PROP_RENDERER_MAX_TEXTURE_SIZE_NUMBER, atlasPageSize);
+	atlasPageSize = SDL_min(atlasPageSize, maxTextureSize);
+	streamTileSize = SDL_clamp(streamTileSize, 64, maxTextureSize);
+	streamRelease = SDL_max(streamRelease, streamPrefetch);
+
+	if (cacheEnabled && !SDL_CreateDirectory(cacheDirectory.c_str())) {
+		LOG("Texture cache disabled, cannot create %s: %s", cacheDirectory.c_str(), SDL_GetError());
+		cacheEnabled = false;
+	}
+
 	return ret;
 }
 
+// Called each loop iteration
+bool Textures::PreUpdate()
+{
+	frame++;
+	if (budgetBytes > 0 && residentBytes > budgetBytes &&
+		(residentBytes != budgetFailedBytes || frame >= budgetFailedFrame + budgetRetryFrames)) EnforceBudget();
+	return true;
+}
+
 // Called before quitting
 bool Textures::CleanUp()
 {
 	LOG("Freeing textures and Image library");
-	for (const auto& texture : textures) {
-		SDL_DestroyTexture(texture);
+	if (evictions > 0) LOG("%d textures were evicted to stay under the video memory budget", evictions);
+
+	// Modules cleaned up later release their handles on an empty cache
+	for (auto& entry : entries) {
+		if (entry.refCount > 0 && entry.texture != nullptr) SDL_DestroyTexture(entry.texture);
 	}
-	textures.clear();
+	for (auto& page : atlasPages) {
+		SDL_DestroyTexture(page.texture);
+	}
+	atlasPages.clear();
+
+	for (auto& image : streamedImages) {
+		for (SDL_Texture* tile : image.tiles) {
+			if (tile != nullptr) SDL_DestroyTexture(tile);
+		}
+	}
+	streamedImages.clear();
+	freeStreamedImages.clear();
+	streamedIndex.clear();
+	streamedBytes = 0;
+
+	entries.clear();
+	freeEntries.clear();
+	pathIndex.clear();
+	residentBytes = 0;
+	budgetFailedBytes = 0;
+	budgetFailedFrame = 0;
 
 	return true;
 }
 
-// Load new texture from file path
-SDL_Texture* const Textures::Load(const char* path)
+// Load new texture from file path, or share the one already loaded from it
+TextureHandle Textures::Acquire(const char* path)
 {
-	SDL_Texture* texture = NULL;
-	SDL_Surface* surface = IMG_Load(path);
+	std::string key = NormalizePath(path);
 
-	if (surface == NULL)
+	auto it = pathIndex.find(key);
+	if (it != pathIndex.end())
 	{
-		LOG("Could not load surface with path: %s. IMG_Load: %s", path, SDL_GetError());
+		TextureEntry& entry = entries[it->second];
+		entry.refCount++;
+		return TextureHandle{ it->second, entry.generation };
+	}
+
+	TextureHandle handle;
+	DecodedImage image;
+
+	if (!DecodeImage(key, image))
+	{
+		LOG("Could not load image with path: %s. %s", path, image.error.c_str());
 	}
 	else
 	{
-		texture = LoadSurface(surface);
-		SDL_DestroySurface(surface); // SDL3: free with SDL_DestroySurface
+		handle = CreateEntry(key, image);
 	}
 
-	return texture;
+	return handle;
+}
+
+TextureHandle Textures::AcquireDecoded(const char* path, const DecodedImage& image)
+{
+	std::string key = NormalizePath(path);
+
+	auto it = pathIndex.find(key);
+	if (it != pathIndex.end())
+	{
+		TextureEntry& entry = entries[it->second];
+		entry.refCount++;
+		return TextureHandle{ it->second, entry.generation };
+	}
+
+	return CreateEntry(key, image);
+}
+
+// Drop a reference, the texture is destroyed with the last one
+void Textures::Release(TextureHandle handle)
+{
+	TextureEntry* entry = Resolve(handle);
+	if (entry == nullptr || --entry->refCount > 0) return;
+
+	if (entry->texture != nullptr)
+	{
+		SDL_DestroyTexture(entry->texture);
+		residentBytes -= entry->bytes;
+	}
+	RemoveFromAtlas(*entry);
+	if (!entry->path.empty()) pathIndex.erase(entry->path);
+
+	entry->path.clear();
+	entry->texture = nullptr;
+	if (++entry->generation == 0) entry->generation = 1;
+	freeEntries.push_back(handle.index);
+}
+
+// Load a group of textures decoding the files concurrently. IMG_Load is safe on independent
+// files, the renderer is not, so workers only produce surfaces
+int Textures::LoadBatch(const std::vector<std::string>& paths, std::vector<TextureHandle>& loaded)
+{
+	int count = (int)paths.size();
+	loaded.assign(count, TextureHandle());
+	if (count == 0) return 0;
+
+	// Only the files not cached yet are decoded, each one once
+	std::vector<std::string> keys(count);
+	std::vector<std::string> decodePaths;
+	std::unordered_map<std::string, int> decodeIndex;
+	for (int i = 0; i < count; ++i)
+	{
+		keys[i] = NormalizePath(paths[i].c_str());
+		if (pathIndex.count(keys[i]) == 0 && decodeIndex.count(keys[i]) == 0)
+		{
+			decodeIndex[keys[i]] = (int)decodePaths.size();
+			decodePaths.push_back(keys[i]);
+		}
+	}
+
+	int decodeCount = (int)decodePaths.size();
+	std::vector<DecodedImage> images(decodeCount);
+	std::atomic<int> next{ 0 };
+
+	auto decode = [&]() {
+		for (int i = next++; i < decodeCount; i = next++) {
+			DecodeImage(decodePaths[i], images[i]);
+		}
+	};
+
+	if (decodeCount > 0)
+	{
+		int threadCount = decodeThreads > 0 ? decodeThreads : (int)std::thread::hardware_concurrency();
+		threadCount = SDL_clamp(threadCount, 1, decodeCount);
+
+		// The calling thread decodes too while the workers run
+		std::vector<std::thread> workers;
+		workers.reserve(threadCount - 1);
+		for (int i = 1; i < threadCount; ++i) workers.emplace_back(decode);
+		decode();
+		for (auto& worker : workers) worker.join();
+	}
+
+	// Tallest images first pack the atlas tighter
+	std::vector<int> order(decodeCount);
+	for (int i = 0; i < decodeCount; ++i) order[i] = i;
+	std::sort(order.begin(), order.end(), [&images](int a, int b) { return images[a].height > images[b].height; });
+
+	int cacheHits = 0;
+	for (int i : order)
+	{
+		if (images[i].pixels == nullptr)
+		{
+			LOG("Could not load image with path: %s. %s", decodePaths[i].c_str(), images[i].error.c_str());
+			continue;
+		}
+		if (images[i].cacheFile.IsOpen()) cacheHits++;
+
+		// Registered without references, the loop below takes them
+		TextureHandle handle = CreateEntry(decodePaths[i], images[i]);
+		if (handle.IsValid()) entries[handle.index].refCount = 0;
+	}
+
+	int ret = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		auto it = pathIndex.find(keys[i]);
+		if (it == pathIndex.end()) continue;
+		entries[it->second].refCount++;
+		loaded[i] = TextureHandle{ it->second, entries[it->second].generation };
+		ret++;
+	}
+
+	if (decodeCount > 0) LOG("Loaded %d images, %d from the decoded texture cache", decodeCount, cacheHits);
+
+	return ret;
 }
 
-// Unload texture
-bool Textures::UnLoad(SDL_Texture* texture)
+bool Textures::Reload(TextureHandle handle)
 {
-	for (const auto& _texture : textures) {
-		if (_texture == texture) {
-			SDL_DestroyTexture(texture);
-			return true;
+	TextureEntry* entry = Resolve(handle);
+	if (entry == nullptr || entry->path.empty()) return false;
+
+	// An evicted texture is decoded from the new file when it is drawn again
+	if (entry->texture == nullptr && entry->atlasPage < 0) return true;
+
+	DecodedImage image;
+	if (!DecodeImage(entry->path, image))
+	{
+		LOG("Could not reload image with path: %s. %s", entry->path.c_str(), image.error.c_str());
+		return false;
+	}
+
+	if (entry->atlasPage >= 0)
+	{
+		// Same size: overwrite the region in the page, otherwise the image leaves the atlas
+		if (image.width == entry->atlasRect.w && image.height == entry->atlasRect.h)
+		{
+			return SDL_UpdateTexture(atlasPages[entry->atlasPage].texture, &entry->atlasRect, image.pixels, image.pitch);
 		}
+
+		SDL_Texture* texture = UploadImage(image);
+		if (texture == NULL) return false;
+
+		RemoveFromAtlas(*entry);
+		entry->texture = texture;
+		ReadSize(*entry);
+		residentBytes += entry->bytes;
+		return true;
 	}
-	return false;
+
+	SDL_Texture* texture = UploadImage(image);
+	if (texture == NULL) return false;
+
+	SDL_DestroyTexture(entry->texture);
+	residentBytes -= entry->bytes;
+	entry->texture = texture;
+	ReadSize(*entry);
+	residentBytes += entry->bytes;
+	return true;
 }
 
 // Translate a surface into a texture
-SDL_Texture* const Textures::LoadSurface(SDL_Surface* surface)
+TextureHandle Textures::LoadSurface(SDL_Surface* surface)
 {
-	SDL_Texture* texture = SDL_CreateTextureFromSurface(Engine::GetInstance().render->renderer, surface);
+	SDL_Texture* texture = CreateTexture(surface);
+	return texture != NULL ? CreateEntry(std::string(), texture) : TextureHandle();
+}
+
+SDL_Texture* Textures::Get(TextureHandle handle, SDL_Rect* region)
+{
+	TextureEntry* entry = Resolve(handle);
+	if (entry == nullptr) return nullptr;
+
+	entry->lastUsedFrame = frame;
+
+	if (entry->atlasPage >= 0)
+	{
+		if (region != nullptr) *region = entry->atlasRect;
+		return atlasPages[entry->atlasPage].texture;
+	}
+
+	if (entry->texture == nullptr) MakeResident(*entry);
+	if (region != nullptr) *region = SDL_Rect{ 0, 0, entry->width, entry->height };
+	return entry->texture;
+}
+
+// Retrieve size of a texture
+void Textures::GetSize(TextureHandle handle, int& width, int& height) const
+{
+	const TextureEntry* entry = Resolve(handle);
+	width = entry != nullptr ? entry->width : 0;
+	height = entry != nullptr ? entry->height : 0;
+}
+
+std::string Textures::NormalizePath(const char* path)
+{
+	std::string ret;
+	if (path == nullptr) return ret;
+
+	std::vector<std::string> segments;
+	bool absolute = *path == '/' || *path == '\\';
+
+	std::string segment;
+	for (const char* c = path;; ++c)
+	{
+		if (*c != '\0' && *c != '/' && *c != '\\')
+		{
+			segment.push_back(*c);
+			continue;
+		}
+
+		if (segment == "..")
+		{
+			if (!segments.empty() && segments.back() != "..") segments.pop_back();
+			else if (!absolute) segments.push_back(segment);
+		}
+		else if (!segment.empty() && segment != ".")
+		{
+			segments.push_back(segment);
+		}
+		segment.clear();
+
+		if (*c == '\0') break;
+	}
 
+	if (absolute) ret.push_back('/');
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		if (i > 0) ret.push_back('/');
+		ret += segments[i];
+	}
+	return ret;
+}
+
+// Get the pixels of an image, from the cache when a file with the same content was seen before.
+// Otherwise decode it, convert it to the texture format, premultiply it and store it in the cache
+bool Textures::DecodeImage(const std::string& path, DecodedImage& image) const
+{
+	SDL_Surface* surface = NULL;
+	AssetFile source;
+	Uint64 sourceHash = 0;
+
+	if (!source.Open(path.c_str()))
+	{
+		image.error = SDL_GetError();
+		return false;
+	}
+
+	if (cacheEnabled)
+	{
+		sourceHash = HashBytes(source.GetData(), source.GetSize());
+
+		if (image.cacheFile.Open(GetCacheFilePath(sourceHash)))
+		{
+			const TextureCacheHeader* header = (const TextureCacheHeader*)image.cacheFile.GetData();
+			bool valid = image.cacheFile.GetSize() >= sizeof(TextureCacheHeader)
+				&& memcmp(header->magic, TEXTURE_CACHE_MAGIC, sizeof(header->magic)) == 0
+				&& header->version == TEXTURE_CACHE_VERSION && header->sourceHash == sourceHash
+				&& header->format == textureFormat && header->width > 0 && header->height > 0
+				&& image.cacheFile.GetSize() >= sizeof(TextureCacheHeader) + (size_t)header->pitch * header->height;
+
+			if (valid)
+			{
+				image.pixels = image.cacheFile.GetData() + sizeof(TextureCacheHeader);
+				image.format = header->format;
+				image.width = header->width;
+				image.height = header->height;
+				image.pitch = header->pitch;
+				return true;
+			}
+			image.cacheFile.Close();
+		}
+	}
+
+	// Decode from the mapping instead of reading the file again
+	surface = IMG_Load_IO(source.OpenStream(), true);
+
+	if (surface == NULL)
+	{
+		image.error = SDL_GetError(); // the error is per thread
+		return false;
+	}
+
+	image.surface = SDL_ConvertSurface(surface, textureFormat);
+	SDL_DestroySurface(surface);
+	if (image.surface == NULL || !SDL_PremultiplySurfaceAlpha(image.surface, false))
+	{
+		image.error = SDL_GetError();
+		return false;
+	}
+
+	if (cacheEnabled) WriteCacheFile(GetCacheFilePath(sourceHash), sourceHash, image.surface);
+
+	image.pixels = image.surface->pixels;
+	image.format = image.surface->format;
+	image.width = image.surface->w;
+	image.height = image.surface->h;
+	image.pitch = image.surface->pitch;
+	return true;
+}
+
+// Written under a temporary name first so a reader never maps a partial file
+bool Textures::WriteCacheFile(const std::string& path, Uint64 sourceHash, SDL_Surface* surface) const
+{
+	TextureCacheHeader header;
+	memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = TEXTURE_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.format = surface->format;
+	header.width = surface->w;
+	header.height = surface->h;
+	header.pitch = surface->pitch;
+
+	std::string temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	SDL_IOStream* file = SDL_IOFromFile(temporary.c_str(), "wb");
+	if (file == NULL) return false;
+
+	size_t pixelBytes = (size_t)surface->pitch * surface->h;
+	bool ok = SDL_WriteIO(file, &header, sizeof(header)) == sizeof(header)
+		&& SDL_WriteIO(file, surface->pixels, pixelBytes) == pixelBytes;
+	ok = SDL_CloseIO(file) && ok;
+
+	if (!ok || !SDL_RenamePath(temporary.c_str(), path.c_str()))
+	{
+		SDL_RemovePath(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+std::string Textures::GetCacheFilePath(Uint64 sourceHash) const
+{
+	char name[40];
+	SDL_snprintf(name, sizeof(name), "%016llx_%08x.tex", (unsigned long long)sourceHash, (unsigned int)textureFormat);
+	return cacheDirectory + name;
+}
+
+// Upload the pixels as they are, they already are in a format the renderer takes
+SDL_Texture* Textures::UploadImage(const DecodedImage& image) const
+{
+	return UploadRegion(image, SDL_Rect{ 0, 0, image.width, image.height });
+}
+
+SDL_Texture* Textures::UploadRegion(const DecodedImage& image, const SDL_Rect& area) const
+{
+	SDL_Texture* texture = SDL_CreateTexture(Engine::GetInstance().render->renderer, image.format, SDL_TEXTUREACCESS_STATIC, area.w, area.h);
+	const Uint8* pixels = (const Uint8*)image.pixels + (size_t)area.y * image.pitch + (size_t)area.x * SDL_BYTESPERPIXEL(image.format);
+
+	if (texture == NULL || !SDL_UpdateTexture(texture, NULL, pixels, image.pitch))
+	{
+		LOG("Unable to create texture from image! SDL Error: %s\n", SDL_GetError());
+		if (texture != NULL) SDL_DestroyTexture(texture);
+		return NULL;
+	}
+
+	SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND_PREMULTIPLIED);
+	return texture;
+}
+
+// Evict the textures drawn longest ago until the resident set fits the budget.
+// Textures drawn in the last frame are kept even over budget, evicting them would only thrash
+void Textures::EnforceBudget()
+{
+	evictionOrder.clear();
+	for (uint32_t i = 0; i < entries.size(); ++i)
+	{
+		const TextureEntry& entry = entries[i];
+		// Textures made from surfaces cannot be loaded again
+		if (entry.refCount > 0 && entry.texture != nullptr && !entry.path.empty() && entry.lastUsedFrame + 1 < frame)
+		{
+			evictionOrder.push_back(i);
+		}
+	}
+
+	std::sort(evictionOrder.begin(), evictionOrder.end(), [this](uint32_t a, uint32_t b) {
+		return entries[a].lastUsedFrame < entries[b].lastUsedFrame;
+	});
+
+	for (uint32_t index : evictionOrder)
+	{
+		if (residentBytes <= budgetBytes) break;
+		Evict(entries[index]);
+	}
+	budgetFailedBytes = residentBytes > budgetBytes ? residentBytes : 0;
+	budgetFailedFrame = frame;
+
+	if (residentBytes > budgetBytes && !overBudgetLogged)
+	{
+		LOG("Textures in use need %d KB, over the %d KB video memory budget", (int)(residentBytes / 1024), (int)(budgetBytes / 1024));
+		overBudgetLogged = true;
+	}
+}
+
+// The entry and its handles stay valid, only the GPU texture is dropped
+void Textures::Evict(TextureEntry& entry)
+{
+	SDL_DestroyTexture(entry.texture);
+	entry.texture = nullptr;
+	residentBytes -= entry.bytes;
+	evictions++;
+}
+
+// Upload an evicted texture again, from the decoded cache when enabled
+bool Textures::MakeResident(TextureEntry& entry)
+{
+	DecodedImage image;
+	if (!DecodeImage(entry.path, image))
+	{
+		LOG("Could not reload evicted image with path: %s. %s", entry.path.c_str(), image.error.c_str());
+		return false;
+	}
+
+	entry.texture = UploadImage(image);
+	if (entry.texture == nullptr) return false;
+
+	ReadSize(entry);
+	residentBytes += entry.bytes;
+	return true;
+}
+
+// ---------- Streaming ----------
+
+StreamedImageHandle Textures::AcquireStreamed(const char* path)
+{
+	std::string key = NormalizePath(path);
+
+	auto it = streamedIndex.find(key);
+	if (it != streamedIndex.end())
+	{
+		StreamedImage& image = streamedImages[it->second];
+		image.refCount++;
+		return StreamedImageHandle{ it->second, image.generation };
+	}
+
+	std::unique_ptr<DecodedImage> pixels(new DecodedImage());
+	if (!DecodeImage(key, *pixels))
+	{
+		LOG("Could not load streamed image with path: %s. %s", path, pixels->error.c_str());
+		return StreamedImageHandle();
+	}
+
+	uint32_t index;
+	if (!freeStreamedImages.empty())
+	{
+		index = freeStreamedImages.back();
+		freeStreamedImages.pop_back();
+	}
+	else
+	{
+		index = (uint32_t)streamedImages.size();
+		streamedImages.emplace_back();
+	}
+
+	StreamedImage& image = streamedImages[index];
+	image.path = key;
+	image.refCount = 1;
+	image.columns = (pixels->width + streamTileSize - 1) / streamTileSize;
+	image.rows = (pixels->height + streamTileSize - 1) / streamTileSize;
+	image.tiles.assign((size_t)image.columns * image.rows, nullptr);
+	image.pixels = std::move(pixels);
+	streamedIndex[key] = index;
+
+	return StreamedImageHandle{ index, image.generation };
+}
+
+void Textures::Release(StreamedImageHandle handle)
+{
+	StreamedImage* image = Resolve(handle);
+	if (image == nullptr || --image->refCount > 0) return;
+
+	for (int tile = 0; tile < (int)image->tiles.size(); ++tile) DestroyTile(*image, tile);
+	streamedIndex.erase(image->path);
+
+	image->path.clear();
+	image->pixels.reset();
+	image->tiles.clear();
+	if (++image->generation == 0) image->generation = 1;
+	freeStreamedImages.push_back(handle.index);
+}
+
+void Textures::GetSize(StreamedImageHandle handle, int& width, int& height) const
+{
+	const StreamedImage* image = Resolve(handle);
+	width = image != nullptr ? image->pixels->width : 0;
+	height = image != nullptr ? image->pixels->height : 0;
+}
+
+bool Textures::StreamTiles(StreamedImageHandle handle, const SDL_Rect& visibleArea, std::vector<StreamedTile>& visibleTiles)
+{
+	visibleTiles.clear();
+	StreamedImage* image = Resolve(handle);
+	if (image == nullptr) return false;
+
+	// Ranges of tile columns (x, w) and rows (y, h)
+	SDL_Rect visible, prefetch, keep;
+	GetTileRange(*image, visibleArea, 0, visible);
+	GetTileRange(*image, visibleArea, streamPrefetch, prefetch);
+	GetTileRange(*image, visibleArea, streamRelease, keep);
+
+	for (int row = 0; row < image->rows; ++row) {
+		for (int column = 0; column < image->columns; ++column) {
+			SDL_Point cell = { column, row };
+			if (!SDL_PointInRect(&cell, &keep)) DestroyTile(*image, row * image->columns + column);
+		}
+	}
+
+	// Visible tiles are always uploaded, the ones ahead of the view only within the per-frame and memory limits
+	int uploads = 0;
+	for (int row = prefetch.y; row < prefetch.y + prefetch.h; ++row) {
+		for (int column = prefetch.x; column < prefetch.x + prefetch.w; ++column) {
+			SDL_Texture*& tile = image->tiles[row * image->columns + column];
+			if (tile != nullptr) continue;
+
+			SDL_Point cell = { column, row };
+			SDL_Rect rect = GetTileRect(*image, column, row);
+			size_t bytes = (size_t)rect.w * rect.h * SDL_BYTESPERPIXEL(image->pixels->format);
+			if (!SDL_PointInRect(&cell, &visible)) {
+				if (uploads >= streamUploads) continue;
+				if (streamBudgetBytes > 0 && streamedBytes + bytes > streamBudgetBytes) continue;
+			}
+
+			tile = UploadRegion(*image->pixels, rect);
+			if (tile == nullptr) continue;
+			streamedBytes += bytes;
+			uploads++;
+		}
+	}
+
+	for (int row = visible.y; row < visible.y + visible.h; ++row) {
+		for (int column = visible.x; column < visible.x + visible.w; ++column) {
+			SDL_Texture* tile = image->tiles[row * image->columns + column];
+			if (tile != nullptr) visibleTiles.push_back(StreamedTile{ tile, GetTileRect(*image, column, row) });
+		}
+	}
+
+	return true;
+}
+
+SDL_Rect Textures::GetTileRect(const StreamedImage& image, int column, int row) const
+{
+	SDL_Rect rect;
+	rect.x = column * streamTileSize;
+	rect.y = row * streamTileSize;
+	rect.w = SDL_min(streamTileSize, image.pixels->width - rect.x);
+	rect.h = SDL_min(streamTileSize, image.pixels->height - rect.y);
+	return rect;
+}
+
+// Tiles overlapping area grown by margin, clamped to the image. Empty when the area is outside
+void Textures::GetTileRange(const StreamedImage& image, const SDL_Rect& area, int margin, SDL_Rect& range) const
+{
+	int left = SDL_max(area.x - margin, 0);
+	int top = SDL_max(area.y - margin, 0);
+	int right = SDL_min(area.x + area.w + margin, image.pixels->width);
+	int bottom = SDL_min(area.y + area.h + margin, image.pixels->height);
+
+	range = SDL_Rect{ 0, 0, 0, 0 };
+	if (right <= left || bottom <= top) return;
+
+	range.x = left / streamTileSize;
+	range.y = top / streamTileSize;
+	range.w = (right - 1) / streamTileSize - range.x + 1;
+	range.h = (bottom - 1) / streamTileSize - range.y + 1;
+}
+
+void Textures::DestroyTile(StreamedImage& image, int tile)
+{
+	if (image.tiles[tile] == nullptr) return;
+
+	SDL_Rect rect = GetTileRect(image, tile % image.columns, tile / image.columns);
+	streamedBytes -= (size_t)rect.w * rect.h * SDL_BYTESPERPIXEL(image.pixels->format);
+	SDL_DestroyTexture(image.tiles[tile]);
+	image.tiles[tile] = nullptr;
+}
+
+// ---------- Atlas ----------
+
+// Place a small image in an atlas page and upload it there
+bool Textures::PackImage(const DecodedImage& image, int& page, SDL_Rect& rect)
+{
+	if (!atlasEnabled || image.format != textureFormat
+		|| image.width > atlasMaxImageSize || image.height > atlasMaxImageSize) return false;
+
+	// One pixel gutter so filtering never samples a neighbour
+	int width = image.width + 1;
+	int height = image.height + 1;
+	if (width > atlasPageSize || height > atlasPageSize) return false;
+
+	int segment = -1;
+	int x = 0;
+	int y = 0;
+	for (page = 0; page < (int)atlasPages.size(); ++page)
+	{
+		if (FindSkylinePosition(atlasPages[page], width, height, segment, x, y)) break;
+	}
+	if (page == (int)atlasPages.size())
+	{
+		page = CreateAtlasPage();
+		if (page < 0 || !FindSkylinePosition(atlasPages[page], width, height, segment, x, y)) return false;
+	}
+
+	rect = SDL_Rect{ x, y, image.width, image.height };
+	if (!SDL_UpdateTexture(atlasPages[page].texture, &rect, image.pixels, image.pitch))
+	{
+		LOG("Unable to upload image to atlas page %d! SDL Error: %s", page, SDL_GetError());
+		return false;
+	}
+
+	AddSkylineLevel(atlasPages[page], segment, x, y, width, height);
+	atlasPages[page].imageCount++;
+	return true;
+}
+
+// Bottom-left skyline: the lowest position where the rectangle fits, leftmost on ties
+bool Textures::FindSkylinePosition(const AtlasPage& page, int width, int height, int& segment, int& x, int& y) const
+{
+	int bestY = INT_MAX;
+	int bestIndex = -1;
+
+	for (int i = 0; i < (int)page.skyline.size(); ++i)
+	{
+		int left = page.skyline[i].x;
+		if (left + width > atlasPageSize) break;
+
+		// The rectangle rests on the highest segment it spans
+		int top = 0;
+		int remaining = width;
+		for (int j = i; remaining > 0; ++j)
+		{
+			top = SDL_max(top, page.skyline[j].y);
+			remaining -= page.skyline[j].width;
+		}
+
+		if (top + height <= atlasPageSize && top < bestY)
+		{
+			bestY = top;
+			bestIndex = i;
+		}
+	}
+
+	if (bestIndex < 0) return false;
+	segment = bestIndex;
+	x = page.skyline[bestIndex].x;
+	y = bestY;
+	return true;
+}
+
+void Textures::AddSkylineLevel(AtlasPage& page, int segment, int x, int y, int width, int height)
+{
+	page.skyline.insert(page.skyline.begin() + segment, SkylineSegment{ x, y + height, width });
+
+	// Trim the segments now covered by the new one
+	for (size_t i = segment + 1; i < page.skyline.size();)
+	{
+		SkylineSegment& current = page.skyline[i];
+		int covered = x + width - current.x;
+		if (covered <= 0) break;
+
+		if (covered >= current.width)
+		{
+			page.skyline.erase(page.skyline.begin() + i);
+			continue;
+		}
+		current.x += covered;
+		current.width -= covered;
+		break;
+	}
+
+	// Merge neighbours at the same height
+	for (size_t i = 0; i + 1 < page.skyline.size();)
+	{
+		if (page.skyline[i].y == page.skyline[i + 1].y)
+		{
+			page.skyline[i].width += page.skyline[i + 1].width;
+			page.skyline.erase(page.skyline.begin() + i + 1);
+		}
+		else ++i;
+	}
+}
+
+int Textures::CreateAtlasPage()
+{
+	SDL_Texture* texture = SDL_CreateTexture(Engine::GetInstance().render->renderer, textureFormat, SDL_TEXTUREACCESS_STATIC, atlasPageSize, atlasPageSize);
 	if (texture == NULL)
 	{
-		LOG("Unable to create texture from surface! SDL Error: %s\n", SDL_GetError());
+		LOG("Unable to create atlas page! SDL Error: %s", SDL_GetError());
+		return -1;
+	}
+
+	// Texture memory starts undefined, gutters must be transparent
+	ClearAtlasPage(texture);
+	SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND_PREMULTIPLIED);
+
+	AtlasPage page;
+	page.texture = texture;
+	page.skyline.push_back(SkylineSegment{ 0, 0, atlasPageSize });
+	atlasPages.push_back(page);
+
+	residentBytes += (size_t)atlasPageSize * atlasPageSize * 4;
+	LOG("Created texture atlas page %d (%dx%d)", (int)atlasPages.size() - 1, atlasPageSize, atlasPageSize);
+	return (int)atlasPages.size() - 1;
+}
+
+void Textures::ClearAtlasPage(SDL_Texture* texture) const
+{
+	std::vector<Uint8> clear((size_t)atlasPageSize * 4 * 64, 0);
+	for (int y = 0; y < atlasPageSize; y += 64)
+	{
+		SDL_Rect rows = { 0, y, atlasPageSize, SDL_min(64, atlasPageSize - y) };
+		SDL_UpdateTexture(texture, &rows, clear.data(), atlasPageSize * 4);
+	}
+}
+
+// Space in a skyline cannot be freed one image at a time, the page is reused once empty
+void Textures::RemoveFromAtlas(TextureEntry& entry)
+{
+	if (entry.atlasPage < 0) return;
+
+	AtlasPage& page = atlasPages[entry.atlasPage];
+	if (--page.imageCount == 0)
+	{
+		page.skyline.clear();
+		page.skyline.push_back(SkylineSegment{ 0, 0, atlasPageSize });
+
+		// Images packed next do not cover the old pixels exactly, their gutters must be transparent again
+		ClearAtlasPage(page.texture);
+	}
+	entry.atlasPage = -1;
+}
+
+TextureHandle Textures::CreateEntry(const std::string& path, const DecodedImage& image)
+{
+	int page = -1;
+	SDL_Rect rect;
+	if (PackImage(image, page, rect))
+	{
+		TextureHandle handle = CreateEntry(path, nullptr);
+		TextureEntry& entry = entries[handle.index];
+		entry.atlasPage = page;
+		entry.atlasRect = rect;
+		entry.width = rect.w;
+		entry.height = rect.h;
+		return handle;
+	}
+
+	SDL_Texture* texture = UploadImage(image);
+	return texture != NULL ? CreateEntry(path, texture) : TextureHandle();
+}
+
+TextureHandle Textures::CreateEntry(const std::string& path, SDL_Texture* texture)
+{
+	uint32_t index;
+	if (!freeEntries.empty())
+	{
+		index = freeEntries.back();
+		freeEntries.pop_back();
 	}
 	else
 	{
-		textures.push_back(texture);
+		index = (uint32_t)entries.size();
+		entries.emplace_back();
 	}
 
-	return texture;
+	TextureEntry& entry = entries[index];
+	entry.path = path;
+	entry.texture = texture;
+	entry.refCount = 1;
+	entry.lastUsedFrame = frame;
+	entry.atlasPage = -1;
+	entry.bytes = 0;
+	if (texture != nullptr)
+	{
+		ReadSize(entry);
+		residentBytes += entry.bytes;
+	}
+	if (!path.empty()) pathIndex[path] = index;
+
+	return TextureHandle{ index, entry.generation };
 }
 
-// Retrieve size of a texture
-void Textures::GetSize(const SDL_Texture* texture, int& width, int& height) const
+void Textures::ReadSize(TextureEntry& entry)
 {
 	float tw = 0.0f;
 	float th = 0.0f;
-	if (!SDL_GetTextureSize((SDL_Texture*)texture, &tw, &th))
+	if (!SDL_GetTextureSize(entry.texture, &tw, &th))
 	{
 		LOG("SDL_GetTextureSize failed: %s", SDL_GetError());
-		width = 0;
-		height = 0;
 	}
-	else
+	entry.width = (int)tw;
+	entry.height = (int)th;
+
+	// Every texture is uploaded in a 32 bit format
+	entry.bytes = (size_t)entry.width * entry.height * 4;
+}
+
+SDL_Texture* Textures::CreateTexture(SDL_Surface* surface) const
+{
+	SDL_Texture* texture = SDL_CreateTextureFromSurface(Engine::GetInstance().render->renderer, surface);
+
+	if (texture == NULL)
 	{
-		width = (int)tw;
-		height = (int)th;
+		LOG("Unable to create texture from surface! SDL Error: %s\n", SDL_GetError());
 	}
+
+	return texture;
+}
+
+Textures::TextureEntry* Textures::Resolve(TextureHandle handle)
+{
+	if (handle.index >= entries.size()) return nullptr;
+	TextureEntry& entry = entries[handle.index];
+	return (entry.refCount > 0 && entry.generation == handle.generation) ? &entry : nullptr;
+}
+
+const Textures::TextureEntry* Textures::Resolve(TextureHandle handle) const
+{
+	if (handle.index >= entries.size()) return nullptr;
+	const TextureEntry& entry = entries[handle.index];
+	return (entry.refCount > 0 && entry.generation == handle.generation) ? &entry : nullptr;
+}
+
+Textures::StreamedImage* Textures::Resolve(StreamedImageHandle handle)
+{
+	if (handle.index >= streamedImages.size()) return nullptr;
+	StreamedImage& image = streamedImages[handle.index];
+	return (image.refCount > 0 && image.generation == handle.generation) ? &image : nullptr;
+}
+
+const Textures::StreamedImage* Textures::Resolve(StreamedImageHandle handle) const
+{
+	if (handle.index >= streamedImages.size()) return nullptr;
+	const StreamedImage& image = streamedImages[handle.index];
+	return (image.refCount > 0 && image.generation == handle.generation) ? &image : nullptr;
 }
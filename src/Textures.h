@@ -1,8 +1,43 @@
 #pragma once
 
 #include "Module.h"
+#include "MappedFile.h"
 #include <SDL3/SDL.h>
 #include <SDL3_image/SDL_image.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+
+// Reference to a texture of the cache, stale once its last reference is released
+struct TextureHandle
+{
+	uint32_t index = 0;
+	uint32_t generation = 0; // never a live generation
+
+	bool IsValid() const { return generation != 0; }
+	bool operator==(const TextureHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const TextureHandle& other) const { return !(*this == other); }
+};
+
+// Reference to a streamed image, stale once its last reference is released
+struct StreamedImageHandle
+{
+	uint32_t index = 0;
+	uint32_t generation = 0; // never a live generation
+
+	bool IsValid() const { return generation != 0; }
+	bool operator==(const StreamedImageHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const StreamedImageHandle& other) const { return !(*this == other); }
+};
+
+// Uploaded tile of a streamed image
+struct StreamedTile
+{
+	SDL_Texture* texture;
+	SDL_Rect rect; // area of the image it covers
+};
 
 class Textures : public Module
 {
@@ -19,16 +54,195 @@ public:
 	// Called before the first frame
 	bool Start();
 
+	// Called each loop iteration
+	bool PreUpdate();
+
 	// Called before quitting
 	bool CleanUp();
 
-	// Load Texture
-	SDL_Texture* const Load(const char* path);
-	SDL_Texture* const LoadSurface(SDL_Surface* surface);
-	bool UnLoad(SDL_Texture* texture);
-	void GetSize(const SDL_Texture* texture, int& width, int& height) const;
+	// Get a reference to the texture of an image file, it is only loaded by the first caller.
+	// Every Acquire must be paired with a Release
+	TextureHandle Acquire(const char* path);
+	void Release(TextureHandle handle);
 
-public:
-	std::list<SDL_Texture*> textures;
+	// Wrap a surface into a texture outside of the path cache, released like the others
+	TextureHandle LoadSurface(SDL_Surface* surface);
+
+	// Load several textures at once: images are decoded in parallel on worker threads and only
+	// the texture creation runs on the calling thread. Paths already cached are only referenced.
+	// loaded[i] is invalid if paths[i] failed
+	int LoadBatch(const std::vector<std::string>& paths, std::vector<TextureHandle>& loaded);
+
+	// Decode the image again, every holder of the handle draws the new texture
+	bool Reload(TextureHandle handle);
+
+	// Texture to draw now, reloaded first if it was evicted. nullptr for stale handles.
+	// Small images live in a shared atlas page: region receives where the image is in the texture
+	SDL_Texture* Get(TextureHandle handle, SDL_Rect* region = nullptr);
+	void GetSize(TextureHandle handle, int& width, int& height) const;
+
+	// Estimated video memory of the textures currently uploaded
+	size_t GetResidentBytes() const { return residentBytes; }
+
+	// Image files currently cached
+	int GetTextureCount() const { return (int)pathIndex.size(); }
+
+	// Images too large to keep as one texture, such as painted backdrops. The pixels stay in system
+	// memory (or the mapped texture cache) and only the tiles around the view are uploaded, so the
+	// image may exceed the renderer's max texture size. Every Acquire must be paired with a Release
+	StreamedImageHandle AcquireStreamed(const char* path);
+	void Release(StreamedImageHandle handle);
+	void GetSize(StreamedImageHandle handle, int& width, int& height) const;
+
+	// Upload the tiles near visibleArea (in image pixels) and release the far ones.
+	// visibleTiles receives the uploaded tiles overlapping visibleArea
+	bool StreamTiles(StreamedImageHandle handle, const SDL_Rect& visibleArea, std::vector<StreamedTile>& visibleTiles);
+
+	// Video memory of the uploaded streamed tiles
+	size_t GetStreamedBytes() const { return streamedBytes; }
+
+	// Unique cache key of a path: forward slashes, no "." nor resolvable ".." segments
+	static std::string NormalizePath(const char* path);
+
+	// Pixels ready to upload, read from a mapped cache file or decoded from the image
+	struct DecodedImage
+	{
+		MappedFile cacheFile;
+		SDL_Surface* surface = nullptr;
+		const void* pixels = nullptr;
+		SDL_PixelFormat format = SDL_PIXELFORMAT_UNKNOWN;
+		int width = 0;
+		int height = 0;
+		int pitch = 0;
+		std::string error;
+
+		~DecodedImage() { if (surface != nullptr) SDL_DestroySurface(surface); }
+	};
+
+	// Safe on worker threads: touches neither the renderer nor the cache entries
+	bool DecodeImage(const std::string& path, DecodedImage& image) const;
+
+	// Acquire with the decoding already done, the image is only uploaded if the path is not cached yet
+	TextureHandle AcquireDecoded(const char* path, const DecodedImage& image);
+
+private:
+
+	struct TextureEntry
+	{
+		std::string path; // normalized, empty for textures made from surfaces
+		SDL_Texture* texture = nullptr;
+		int width = 0;
+		int height = 0;
+		int refCount = 0;
+		uint32_t generation = 1;
+		size_t bytes = 0;         // estimated video memory once uploaded
+		uint64_t lastUsedFrame = 0;
+		int atlasPage = -1;       // packed images have no texture of their own
+		SDL_Rect atlasRect = { 0, 0, 0, 0 };
+	};
+
+	struct StreamedImage
+	{
+		std::string path;
+		std::unique_ptr<DecodedImage> pixels; // source of the tile uploads
+		int refCount = 0;
+		uint32_t generation = 1;
+		int columns = 0;
+		int rows = 0;
+		std::vector<SDL_Texture*> tiles; // row major, nullptr while not uploaded
+	};
+
+	struct SkylineSegment
+	{
+		int x;
+		int y;
+		int width;
+	};
+
+	// Atlas pages are pinned: never evicted, reset once every image in them is released
+	struct AtlasPage
+	{
+		SDL_Texture* texture = nullptr;
+		std::vector<SkylineSegment> skyline;
+		int imageCount = 0;
+	};
+
+	bool WriteCacheFile(const std::string& path, Uint64 sourceHash, SDL_Surface* surface) const;
+	std::string GetCacheFilePath(Uint64 sourceHash) const;
+	SDL_Texture* UploadImage(const DecodedImage& image) const;
+	SDL_Texture* UploadRegion(const DecodedImage& image, const SDL_Rect& area) const;
+
+	// Residency
+	void EnforceBudget();
+	void Evict(TextureEntry& entry);
+	bool MakeResident(TextureEntry& entry);
+
+	// Atlas packing
+	bool PackImage(const DecodedImage& image, int& page, SDL_Rect& rect);
+	bool FindSkylinePosition(const AtlasPage& page, int width, int height, int& segment, int& x, int& y) const;
+	void AddSkylineLevel(AtlasPage& page, int segment, int x, int y, int width, int height);
+	int CreateAtlasPage();
+	void ClearAtlasPage(SDL_Texture* texture) const;
+	void RemoveFromAtlas(TextureEntry& entry);
+
+	// Streaming
+	SDL_Rect GetTileRect(const StreamedImage& image, int column, int row) const;
+	void GetTileRange(const StreamedImage& image, const SDL_Rect& area, int margin, SDL_Rect& range) const;
+	void DestroyTile(StreamedImage& image, int tile);
+	StreamedImage* Resolve(StreamedImageHandle handle);
+	const StreamedImage* Resolve(StreamedImageHandle handle) const;
+
+	TextureHandle CreateEntry(const std::string& path, const DecodedImage& image);
+	TextureHandle CreateEntry(const std::string& path, SDL_Texture* texture);
+	SDL_Texture* CreateTexture(SDL_Surface* surface) const;
+	static void ReadSize(TextureEntry& entry);
+	TextureEntry* Resolve(TextureHandle handle);
+	const TextureEntry* Resolve(TextureHandle handle) const;
+
+private:
+
+	std::vector<TextureEntry> entries;
+	std::vector<uint32_t> freeEntries;
+	std::unordered_map<std::string, uint32_t> pathIndex;
+
+	// Decode threads of LoadBatch, 0 uses one per core
+	int decodeThreads = 0;
+
+	// On-disk cache of decoded, premultiplied pixels in the renderer format, keyed by the source file hash
+	bool cacheEnabled = true;
+	std::string cacheDirectory = "Cache/Textures/";
+	SDL_PixelFormat textureFormat = SDL_PIXELFORMAT_ARGB8888;
+
+	// Least recently drawn textures are evicted above the budget, 0 keeps everything resident
+	size_t budgetBytes = 0;
+	size_t residentBytes = 0;
+	uint64_t frame = 1;
+	int evictions = 0;
+	std::vector<uint32_t> evictionOrder;
+	bool overBudgetLogged = false;
+	// Resident bytes and frame of the last pass that could not get under budget, 0 after one that did.
+	// The pass runs again once the resident set changes, or budgetRetryFrames later for the textures
+	// that stopped being drawn in the meantime
+	size_t budgetFailedBytes = 0;
+	uint64_t budgetFailedFrame = 0;
+	static const int budgetRetryFrames = 30;
+
+	// Images up to atlasMaxImageSize pixels per side are packed into shared pages
+	bool atlasEnabled = true;
+	int atlasPageSize = 2048;
+	int atlasMaxImageSize = 512;
+	std::vector<AtlasPage> atlasPages;
 
+	// Streamed images are cut in tiles of streamTileSize. Tiles within streamPrefetch pixels of the view are
+	// uploaded ahead, at most streamUploads per frame and while under the streaming budget (0 for no limit);
+	// tiles further than streamRelease pixels are released
+	int streamTileSize = 512;
+	int streamPrefetch = 256;
+	int streamRelease = 1024;
+	int streamUploads = 2;
+	size_t streamBudgetBytes = 0;
+	size_t streamedBytes = 0;
+	std::vector<StreamedImage> streamedImages;
+	std::vector<uint32_t> freeStreamedImages;
+	std::unordered_map<std::string, uint32_t> streamedIndex;
 };
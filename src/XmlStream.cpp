@@ -0,0 +1,390 @@
+#include "XmlStream.h"
+#include "Engine.h"
+#include "AssetPack.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// Bytes read from disk at a time, the only part of the file held in memory
+#define XML_CHUNK_SIZE 16384
+
+XmlStream::XmlStream()
+{
+	arena.reserve(256);
+	arena.push_back('\0');
+}
+
+// Destructor
+XmlStream::~XmlStream()
+{
+	Close();
+}
+
+bool XmlStream::Open(const std::string& filePath)
+{
+	Close();
+
+	path = filePath;
+
+	// Packed XML is stored uncompressed and read in place from the pack mapping, loose files
+	// are read from disk chunk by chunk: neither loads the whole file
+	const std::shared_ptr<AssetPack>& pack = Engine::GetInstance().pack;
+	const PackEntry* entry = pack != nullptr ? pack->Find(path.c_str()) : nullptr;
+	if (entry != nullptr) {
+		file = pack->OpenStream(*entry);
+		if (file == nullptr) SDL_SetError("packed file is compressed, rebuild the pack");
+	}
+	else {
+		file = SDL_IOFromFile(path.c_str(), "rb");
+	}
+
+	if (file == nullptr) {
+		failed = true;
+		error = "cannot open " + path + ": " + SDL_GetError();
+		return false;
+	}
+
+	buffer.resize(XML_CHUNK_SIZE);
+	position = 0;
+	length = 0;
+	line = 1;
+	depth = 0;
+	pendingEnd = false;
+	insideText = false;
+	failed = false;
+	error.clear();
+	return true;
+}
+
+void XmlStream::Close()
+{
+	if (file != nullptr) {
+		SDL_CloseIO(file);
+		file = nullptr;
+	}
+
+	// Give the memory back, the reader can outlive the load
+	std::vector<char>().swap(buffer);
+	std::vector<Attr>().swap(attributes);
+	std::vector<char>(1, '\0').swap(arena);
+	nameOffset = 0;
+}
+
+XmlStream::Token XmlStream::Next()
+{
+	if (failed) return Token::ERROR;
+
+	if (pendingEnd) {
+		pendingEnd = false;
+		depth--;
+		return Token::END;
+	}
+	insideText = false;
+
+	for (;;) {
+		// Skip text up to the next tag
+		int c = Get();
+		while (c != '<') {
+			if (c < 0) {
+				if (depth > 0) Fail("unexpected end of file");
+				return failed ? Token::ERROR : Token::END_OF_FILE;
+			}
+			c = Get();
+		}
+
+		c = Peek();
+		if (c == '?') {
+			if (!SkipUntil("?>")) return Token::ERROR;
+			continue;
+		}
+		if (c == '!') {
+			Get();
+			bool comment = Peek() == '-';
+			if (!SkipUntil(comment ? "-->" : ">")) return Token::ERROR;
+			continue;
+		}
+
+		arena.clear();
+		attributes.clear();
+		nameOffset = 0;
+
+		if (c == '/') {
+			Get();
+			if (!ReadName()) return Token::ERROR;
+			SkipSpaces();
+			if (Get() != '>') {
+				Fail("expected '>' closing an end tag");
+				return Token::ERROR;
+			}
+			if (--depth < 0) {
+				Fail("end tag without a start tag");
+				return Token::ERROR;
+			}
+			return Token::END;
+		}
+
+		if (!ReadName()) return Token::ERROR;
+
+		for (;;) {
+			SkipSpaces();
+			c = Peek();
+			if (c == '/') {
+				Get();
+				if (Get() != '>') {
+					Fail("expected '>' after '/'");
+					return Token::ERROR;
+				}
+				depth++;
+				pendingEnd = true;
+				return Token::START;
+			}
+			if (c == '>') {
+				Get();
+				depth++;
+				insideText = true;
+				return Token::START;
+			}
+
+			Attr attr;
+			attr.name = arena.size();
+			if (!ReadName()) return Token::ERROR;
+			SkipSpaces();
+			if (Get() != '=') {
+				Fail("expected '=' after an attribute name");
+				return Token::ERROR;
+			}
+			SkipSpaces();
+			int quote = Get();
+			if (quote != '"' && quote != '\'') {
+				Fail("expected a quoted attribute value");
+				return Token::ERROR;
+			}
+			attr.value = arena.size();
+			if (!ReadAttributeValue(quote)) return Token::ERROR;
+			attributes.push_back(attr);
+		}
+	}
+}
+
+bool XmlStream::NextChild(int parentDepth)
+{
+	for (;;) {
+		Token token = Next();
+		if (token == Token::START) {
+			if (depth == parentDepth + 1) return true;
+		}
+		else if (token == Token::END) {
+			if (depth < parentDepth) return false;
+		}
+		else {
+			return false;
+		}
+	}
+}
+
+bool XmlStream::IsNamed(const char* name) const
+{
+	return strcmp(Name(), name) == 0;
+}
+
+const char* XmlStream::Attribute(const char* name, const char* defaultValue) const
+{
+	for (const Attr& attr : attributes) {
+		if (strcmp(&arena[attr.name], name) == 0) return &arena[attr.value];
+	}
+	return defaultValue;
+}
+
+int XmlStream::AttributeInt(const char* name, int defaultValue) const
+{
+	const char* value = Attribute(name);
+	return value != nullptr ? (int)strtol(value, nullptr, 10) : defaultValue;
+}
+
+unsigned int XmlStream::AttributeUInt(const char* name, unsigned int defaultValue) const
+{
+	const char* value = Attribute(name);
+	return value != nullptr ? (unsigned int)strtoul(value, nullptr, 10) : defaultValue;
+}
+
+float XmlStream::AttributeFloat(const char* name, float defaultValue) const
+{
+	const char* value = Attribute(name);
+	return value != nullptr ? strtof(value, nullptr) : defaultValue;
+}
+
+bool XmlStream::AttributeBool(const char* name, bool defaultValue) const
+{
+	const char* value = Attribute(name);
+	if (value == nullptr) return defaultValue;
+	return *value == '1' || *value == 't' || *value == 'T' || *value == 'y' || *value == 'Y';
+}
+
+bool XmlStream::ReadCsvValue(unsigned int& value)
+{
+	if (!insideText || failed) return false;
+
+	int c = Peek();
+	while (c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+		Get();
+		c = Peek();
+	}
+
+	// The tag that ends the text is left for Next
+	if (c == '<' || c < 0) {
+		insideText = false;
+		return false;
+	}
+	if (c < '0' || c > '9') return Fail("unexpected character in CSV data");
+
+	value = 0;
+	while (c >= '0' && c <= '9') {
+		value = value * 10 + (unsigned int)(Get() - '0');
+		c = Peek();
+	}
+	return true;
+}
+
+bool XmlStream::ReadText(std::string& text)
+{
+	text.clear();
+	if (!insideText || failed) return false;
+
+	for (int c = Peek(); c >= 0 && c != '<'; c = Peek()) {
+		text.push_back((char)Get());
+	}
+	insideText = false;
+	return true;
+}
+
+// ---------- Input ----------
+
+bool XmlStream::Fill()
+{
+	if (file == nullptr) return false;
+
+	position = 0;
+	length = SDL_ReadIO(file, buffer.data(), buffer.size());
+	return length > 0;
+}
+
+int XmlStream::Peek()
+{
+	if (position >= length && !Fill()) return -1;
+	return (unsigned char)buffer[position];
+}
+
+int XmlStream::Get()
+{
+	if (position >= length && !Fill()) return -1;
+	char c = buffer[position++];
+	if (c == '\n') line++;
+	return (unsigned char)c;
+}
+
+void XmlStream::SkipSpaces()
+{
+	int c = Peek();
+	while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+		Get();
+		c = Peek();
+	}
+}
+
+bool XmlStream::ReadName()
+{
+	size_t start = arena.size();
+	for (int c = Peek(); c >= 0; c = Peek()) {
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '/' || c == '>' || c == '=') break;
+		PushChar((char)Get());
+	}
+	if (arena.size() == start) return Fail("expected a name");
+	PushTerminator();
+	return true;
+}
+
+bool XmlStream::ReadAttributeValue(int quote)
+{
+	for (;;) {
+		int c = Get();
+		if (c < 0) return Fail("unexpected end of file in an attribute value");
+		if (c == quote) break;
+		if (c != '&') {
+			PushChar((char)c);
+			continue;
+		}
+
+		// Character and predefined entity references
+		char entity[12];
+		int n = 0;
+		for (c = Get(); c >= 0 && c != ';' && n < 11; c = Get()) entity[n++] = (char)c;
+		entity[n] = '\0';
+		if (c != ';') return Fail("unterminated entity reference");
+
+		if (strcmp(entity, "amp") == 0) PushChar('&');
+		else if (strcmp(entity, "lt") == 0) PushChar('<');
+		else if (strcmp(entity, "gt") == 0) PushChar('>');
+		else if (strcmp(entity, "quot") == 0) PushChar('"');
+		else if (strcmp(entity, "apos") == 0) PushChar('\'');
+		else if (entity[0] == '#') {
+			unsigned long code = entity[1] == 'x' ? strtoul(entity + 2, nullptr, 16) : strtoul(entity + 1, nullptr, 10);
+			// Encode the code point as UTF-8
+			if (code < 0x80) {
+				PushChar((char)code);
+			}
+			else if (code < 0x800) {
+				PushChar((char)(0xC0 | (code >> 6)));
+				PushChar((char)(0x80 | (code & 0x3F)));
+			}
+			else if (code < 0x10000) {
+				PushChar((char)(0xE0 | (code >> 12)));
+				PushChar((char)(0x80 | ((code >> 6) & 0x3F)));
+				PushChar((char)(0x80 | (code & 0x3F)));
+			}
+			else {
+				PushChar((char)(0xF0 | (code >> 18)));
+				PushChar((char)(0x80 | ((code >> 12) & 0x3F)));
+				PushChar((char)(0x80 | ((code >> 6) & 0x3F)));
+				PushChar((char)(0x80 | (code & 0x3F)));
+			}
+		}
+		else return Fail("unknown entity reference");
+	}
+
+	PushTerminator();
+	return true;
+}
+
+// Skip input until the terminator has been read, comparing against the last characters seen
+bool XmlStream::SkipUntil(const char* terminator)
+{
+	size_t size = strlen(terminator);
+	char recent[4] = { 0 };
+	size_t seen = 0;
+
+	for (int c = Get(); c >= 0; c = Get()) {
+		memmove(recent, recent + 1, size - 1);
+		recent[size - 1] = (char)c;
+		if (++seen >= size && memcmp(recent, terminator, size) == 0) return true;
+	}
+	return Fail("unexpected end of file");
+}
+
+bool XmlStream::Fail(const char* message)
+{
+	if (!failed) {
+		failed = true;
+		error = path + ":" + std::to_string(line) + ": " + message;
+	}
+	return false;
+}
+
+void XmlStream::PushChar(char c)
+{
+	arena.push_back(c);
+}
+
+void XmlStream::PushTerminator()
+{
+	arena.push_back('\0');
+}
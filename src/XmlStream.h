@@ -0,0 +1,107 @@
+#pragma once
+
+#include <SDL3/SDL.h>
+#include <string>
+#include <vector>
+
+// Forward-only XML reader for large asset files.
+// Reads the file in fixed-size chunks and keeps only the current tag: names and attribute
+// values live in a scratch arena that is reused for every tag and freed with the reader.
+// Self-closing elements are reported as a START followed by an END.
+class XmlStream
+{
+public:
+
+	enum class Token
+	{
+		START,
+		END,
+		END_OF_FILE,
+		ERROR
+	};
+
+	XmlStream();
+
+	// Destructor
+	~XmlStream();
+
+	XmlStream(const XmlStream&) = delete;
+	XmlStream& operator=(const XmlStream&) = delete;
+
+	bool Open(const std::string& path);
+	void Close();
+
+	// Advance to the next start or end tag, text and comments are skipped
+	Token Next();
+
+	// Advance to the next child of the element opened at parentDepth, skipping the rest of
+	// the previous child. Returns false once the parent element is closed.
+	bool NextChild(int parentDepth);
+
+	// Depth of the current element, 1 for the root once its START is read
+	int Depth() const { return depth; }
+
+	// Current tag
+	const char* Name() const { return &arena[nameOffset]; }
+	bool IsNamed(const char* name) const;
+
+	// Attributes of the current START tag, entities already decoded
+	const char* Attribute(const char* name, const char* defaultValue = nullptr) const;
+	int AttributeInt(const char* name, int defaultValue = 0) const;
+	unsigned int AttributeUInt(const char* name, unsigned int defaultValue = 0) const;
+	float AttributeFloat(const char* name, float defaultValue = 0.0f) const;
+	bool AttributeBool(const char* name, bool defaultValue = false) const;
+
+	// Read the next number of a comma separated text block, such as a Tiled CSV layer.
+	// Returns false at the end of the text.
+	bool ReadCsvValue(unsigned int& value);
+
+	// Text content of the current element up to its first child or end tag
+	bool ReadText(std::string& text);
+
+	bool Failed() const { return failed; }
+	const std::string& GetError() const { return error; }
+
+private:
+
+	struct Attr
+	{
+		size_t name;
+		size_t value;
+	};
+
+	// Character input over the chunk buffer
+	bool Fill();
+	int Peek();
+	int Get();
+	void SkipSpaces();
+
+	bool ReadName();
+	bool ReadAttributeValue(int quote);
+	bool SkipUntil(const char* terminator);
+	bool Fail(const char* message);
+
+	void PushChar(char c);
+	void PushTerminator();
+
+private:
+
+	SDL_IOStream* file = nullptr;
+	std::string path;
+
+	std::vector<char> buffer;
+	size_t position = 0;
+	size_t length = 0;
+	int line = 1;
+
+	// Scratch storage of the current tag
+	std::vector<char> arena;
+	std::vector<Attr> attributes;
+	size_t nameOffset = 0;
+
+	int depth = 0;
+	bool pendingEnd = false; // self-closing tag, its END is reported on the next call
+	bool insideText = false; // a START was just read and its text has not been skipped
+	bool failed = false;
+	std::string error;
+};
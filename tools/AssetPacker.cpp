@@ -0,0 +1,184 @@
+// Builds the asset pack read by AssetPack at runtime.
+// Usage: AssetPacker <assets folder> <output pack> [--store]
+// Files are named by their path as given, so run it from the folder the game runs from:
+//     AssetPacker Assets Assets.pak
+// Entries are compressed when it saves at least an eighth of their size, --store disables it.
+// XML files are always stored so the game can stream them straight from the pack.
+
+#include "../src/AssetPackFormat.h"
+#include "../src/PackCompression.h"
+
+#include <cctype>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+struct PackedFile
+{
+	std::string name;
+	fs::path source;
+	PackEntry entry;
+};
+
+static bool ReadFile(const fs::path& path, std::vector<uint8_t>& bytes)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return false;
+	bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return !file.bad();
+}
+
+// Files XmlStream reads in chunks, see XmlStream::Open
+static bool IsStreamedPath(const std::string& name)
+{
+	static const char* extensions[] = { ".xml", ".tmx", ".tsx" };
+
+	std::string lower = name;
+	for (char& c : lower) c = (char)tolower((unsigned char)c);
+	for (const char* extension : extensions) {
+		size_t length = strlen(extension);
+		if (lower.size() >= length && lower.compare(lower.size() - length, length, extension) == 0) return true;
+	}
+	return false;
+}
+
+static void Pad(std::ofstream& out, uint64_t& position)
+{
+	static const char zeros[PACK_ALIGNMENT] = { 0 };
+	uint64_t padding = (PACK_ALIGNMENT - position % PACK_ALIGNMENT) % PACK_ALIGNMENT;
+	out.write(zeros, (std::streamsize)padding);
+	position += padding;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <assets folder> <output pack> [--store]\n", argv[0]);
+		return 1;
+	}
+
+	fs::path root = argv[1];
+	fs::path output = argv[2];
+	bool compress = !(argc > 3 && strcmp(argv[3], "--store") == 0);
+
+	std::error_code error;
+	if (!fs::is_directory(root, error)) {
+		fprintf(stderr, "%s is not a folder\n", root.string().c_str());
+		return 1;
+	}
+
+	std::vector<PackedFile> files;
+	for (const fs::directory_entry& item : fs::recursive_directory_iterator(root, error)) {
+		if (!item.is_regular_file()) continue;
+
+		std::string fileName = item.path().filename().string();
+		if (fileName.empty() || fileName[0] == '.' || fileName == "desktop.ini") continue;
+
+		PackedFile file;
+		file.name = item.path().lexically_normal().generic_string();
+		if (file.name.compare(0, 2, "./") == 0) file.name.erase(0, 2);
+		file.source = item.path();
+		memset(&file.entry, 0, sizeof(file.entry));
+		file.entry.pathHash = PackHashPath(file.name.c_str(), file.name.size());
+		files.push_back(file);
+	}
+	if (error) {
+		fprintf(stderr, "Cannot list %s: %s\n", root.string().c_str(), error.message().c_str());
+		return 1;
+	}
+
+	// The runtime binary searches the table by hash
+	std::sort(files.begin(), files.end(), [](const PackedFile& a, const PackedFile& b) {
+		return a.entry.pathHash != b.entry.pathHash ? a.entry.pathHash < b.entry.pathHash : a.name < b.name;
+	});
+
+	fs::path temporary = output;
+	temporary += ".tmp";
+	std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		fprintf(stderr, "Cannot write %s\n", temporary.string().c_str());
+		return 1;
+	}
+
+	PackHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+	header.version = PACK_VERSION;
+	header.entryCount = (uint32_t)files.size();
+	out.write((const char*)&header, sizeof(header));
+	uint64_t position = sizeof(header);
+
+	std::vector<uint8_t> bytes;
+	std::vector<uint8_t> compressed;
+	uint64_t rawTotal = 0;
+	uint64_t storedTotal = 0;
+	std::string names;
+
+	for (PackedFile& file : files) {
+		if (!ReadFile(file.source, bytes)) {
+			fprintf(stderr, "Cannot read %s\n", file.source.string().c_str());
+			return 1;
+		}
+
+		const std::vector<uint8_t>* data = &bytes;
+		file.entry.compression = PACK_STORED;
+		if (compress && !bytes.empty() && !IsStreamedPath(file.name)) {
+			PackCompress(bytes.data(), bytes.size(), compressed);
+			if (compressed.size() <= bytes.size() - bytes.size() / 8) {
+				data = &compressed;
+				file.entry.compression = PACK_LZ;
+			}
+		}
+
+		Pad(out, position);
+		file.entry.offset = position;
+		file.entry.size = data->size();
+		file.entry.rawSize = bytes.size();
+		file.entry.nameOffset = (uint32_t)names.size();
+		names.append(file.name.c_str(), file.name.size() + 1);
+
+		out.write((const char*)data->data(), (std::streamsize)data->size());
+		position += data->size();
+		rawTotal += bytes.size();
+		storedTotal += data->size();
+
+		printf("%-60s %10llu -> %10llu%s\n", file.name.c_str(), (unsigned long long)bytes.size(),
+			(unsigned long long)data->size(), file.entry.compression == PACK_LZ ? " lz" : "");
+	}
+
+	Pad(out, position);
+	header.tocOffset = position;
+	for (const PackedFile& file : files) {
+		out.write((const char*)&file.entry, sizeof(file.entry));
+		position += sizeof(file.entry);
+	}
+
+	header.namesOffset = position;
+	out.write(names.data(), (std::streamsize)names.size());
+
+	out.seekp(0);
+	out.write((const char*)&header, sizeof(header));
+	out.close();
+	if (!out) {
+		fprintf(stderr, "Cannot write %s\n", temporary.string().c_str());
+		return 1;
+	}
+
+	// Replace the old pack only once the new one is complete
+	fs::rename(temporary, output, error);
+	if (error) {
+		fprintf(stderr, "Cannot replace %s: %s\n", output.string().c_str(), error.message().c_str());
+		return 1;
+	}
+
+	printf("%zu files, %llu bytes packed into %llu\n", files.size(), (unsigned long long)rawTotal, (unsigned long long)storedTotal);
+	return 0;
+}